@@ -0,0 +1,77 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <iomidipp/MidiEventList.h>
+#include <iomidipp/Utils.h>
+
+namespace imp {
+
+// ColumnarTrack -- Structure-of-arrays copy of a MidiEventList.  Every
+//    event has one entry in each of the tick, track, seq, seconds, status,
+//    data1 and data2 columns.  Messages which do not fit into status/data1/data2
+//    (meta and sysex messages, or channel messages with an unusual
+//    length) are additionally stored whole in the payload blob; the
+//    bytes of event i are payload[payloadOffsets[i]] up to
+//    payload[payloadOffsets[i + 1]], which is empty for plain channel
+//    messages.  For meta messages data1 holds the meta type.
+//
+//    Scans over a single property (e.g. all note-ons of one channel)
+//    then become linear passes over small arrays.  Converting back gives
+//    the same messages, ticks, tracks, sequence numbers and seconds; links
+//    between events are not stored.
+class ColumnarTrack {
+public:
+    ColumnarTrack() = default;
+
+    explicit ColumnarTrack(const MidiEventList& list);
+
+    // convert back into MidiEvents, without links:
+    [[nodiscard]] MidiEventList toEventList() const;
+
+    [[nodiscard]] std::size_t size() const {
+        return ticks.size();
+    }
+
+    [[nodiscard]] bool empty() const {
+        return ticks.empty();
+    }
+
+    void clear();
+
+    void reserve(std::size_t events);
+
+    void push_back(const MidiEvent& event);
+
+    // message bytes of event i if it is stored in the payload blob:
+    [[nodiscard]] std::span<const uchar> getPayload(std::size_t i) const {
+        return {payload.data() + payloadOffsets[i], payload.data() + payloadOffsets[i + 1]};
+    }
+
+    // message size of event i in bytes, as MidiMessage::getSize():
+    [[nodiscard]] std::size_t getMessageSize(std::size_t i) const;
+
+    // indices of all events whose status byte is command | channel
+    // (channel < 0 matches all channels); note-ons with velocity 0
+    // are excluded when command is 0x90.
+    [[nodiscard]] std::vector<std::size_t> findCommand(int command, int channel = -1) const;
+
+    std::vector<int> ticks;
+    std::vector<int> tracks;
+    std::vector<int> seqs;
+    std::vector<double> seconds;
+    std::vector<uchar> status;
+    std::vector<uchar> data1;
+    std::vector<uchar> data2;
+    std::vector<std::uint32_t> payloadOffsets = {0};
+    std::vector<uchar> payload;
+};
+
+}// namespace imp
@@ -0,0 +1,196 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <iomidipp/MappedFile.h>
+#include <iomidipp/MidiMessage.h>
+#include <iomidipp/Utils.h>
+
+namespace imp::File {
+
+// MessageView -- Non-owning view of one MIDI message inside a Standard
+//    MIDI File buffer.  Byte i of the view is byte i of the MidiMessage
+//    that File::read() would create: the status byte followed by the
+//    payload.  Running status is resolved, so the status byte is always
+//    present, and the payload points straight into the file data.
+class MessageView {
+public:
+    MessageView() = default;
+
+    MessageView(uchar status, std::span<const uchar> payload)
+        : m_status(status)
+        , m_payload(payload) {}
+
+    [[nodiscard]] std::size_t getSize() const {
+        return m_status == 0 ? 0 : 1 + m_payload.size();
+    }
+
+    uchar operator[](std::size_t i) const {
+        return i == 0 ? m_status : m_payload[i - 1];
+    }
+
+    [[nodiscard]] std::span<const uchar> getPayload() const {
+        return m_payload;
+    }
+
+    // data access convenience functions (returns -1 if not present):
+    [[nodiscard]] int getP0() const;
+
+    [[nodiscard]] int getP1() const;
+
+    [[nodiscard]] int getP2() const;
+
+    int getCommandNibble() const;
+
+    int getChannel() const;
+
+    bool isMeta() const;
+
+    int getMetaType() const;
+
+    bool isNoteOn() const;
+
+    bool isNoteOff() const;
+
+    bool isTempo() const;
+
+    bool isEndOfTrack() const;
+
+    // copy the viewed bytes into an owning MidiMessage:
+    MidiMessage toMessage() const;
+
+private:
+    uchar m_status = 0;
+    std::span<const uchar> m_payload;
+};
+
+// StreamEvent -- One event produced by the cursors below.
+struct StreamEvent {
+    int track = 0;       // track number of the event in the MIDI file
+    int tick = 0;        // absolute MIDI ticks
+    MessageView message; // valid as long as the file data is
+};
+
+// TrackCursor -- Decodes the events of one MTrk chunk on demand.  The
+//    cursor only keeps its position, the running status and the current
+//    tick, so it needs constant memory regardless of the track length.
+class TrackCursor {
+public:
+    TrackCursor() = default;
+
+    // with quiet, errors in the data are not printed:
+    TrackCursor(const uchar* begin, const uchar* end, int track, bool quiet = false)
+        : m_pos(begin)
+        , m_end(end)
+        , m_track(track)
+        , m_done(begin >= end)
+        , m_quiet(quiet) {}
+
+    // returns false after the end-of-track message or on an error:
+    bool next(StreamEvent& event);
+
+    [[nodiscard]] bool failed() const {
+        return m_failed;
+    }
+
+    // position of the first byte after the last decoded event:
+    [[nodiscard]] const uchar* position() const {
+        return m_pos;
+    }
+
+private:
+    const uchar* m_pos = nullptr;
+    const uchar* m_end = nullptr;
+    int m_track = 0;
+    int m_tick = 0;
+    uchar m_runningCommand = 0;
+    bool m_done = true;
+    bool m_failed = false;
+    bool m_quiet = false;
+};
+
+// EventCursor -- Pull-style reader that yields the events of a Standard
+//    MIDI File one at a time in file order (track by track), without
+//    building a MidiData.
+class EventCursor {
+public:
+    explicit EventCursor(const std::string& filename);
+
+    explicit EventCursor(std::span<const std::byte> buffer);
+
+    bool next(StreamEvent& event);
+
+    [[nodiscard]] int getTrackCount() const {
+        return m_trackCount;
+    }
+
+    [[nodiscard]] int getTicksPerQuarterNote() const {
+        return m_ticksPerQuarterNote;
+    }
+
+    [[nodiscard]] bool failed() const {
+        return m_failed;
+    }
+
+private:
+    void open(std::span<const std::byte> buffer);
+
+    std::optional<MappedFile> m_file;
+    const uchar* m_end = nullptr;
+    int m_trackCount = 0;
+    int m_ticksPerQuarterNote = 0;
+    int m_nextTrack = 0;
+    TrackCursor m_track;
+    bool m_failed = false;
+};
+
+// MergedEventCursor -- Pull-style reader that yields the events of all
+//    tracks merged in time order.  Events at the same tick come in the
+//    same order as after File::read() and MidiData::joinTracks(): lower
+//    track numbers first, then file order.  Memory use is one cursor
+//    and one pending event per track.
+class MergedEventCursor {
+public:
+    explicit MergedEventCursor(const std::string& filename);
+
+    explicit MergedEventCursor(std::span<const std::byte> buffer);
+
+    bool next(StreamEvent& event);
+
+    [[nodiscard]] int getTrackCount() const {
+        return (int) m_tracks.size();
+    }
+
+    [[nodiscard]] int getTicksPerQuarterNote() const {
+        return m_ticksPerQuarterNote;
+    }
+
+    [[nodiscard]] bool failed() const {
+        return m_failed;
+    }
+
+private:
+    void open(std::span<const std::byte> buffer);
+
+    void advance(int track);
+
+    bool isLater(int a, int b) const;
+
+    std::optional<MappedFile> m_file;
+    int m_ticksPerQuarterNote = 0;
+    std::vector<TrackCursor> m_tracks;
+    std::vector<StreamEvent> m_pending;
+    // m_heap == tracks with a pending event, as a min-heap on (tick, track).
+    std::vector<int> m_heap;
+    bool m_failed = false;
+};
+
+}// namespace imp::File
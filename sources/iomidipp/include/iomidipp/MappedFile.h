@@ -0,0 +1,51 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+namespace imp {
+
+// MappedFile -- read-only view of a whole file.  On POSIX systems the
+//    file is memory-mapped, elsewhere it is read into memory in a single
+//    call.  Either way the bytes stay valid for the lifetime of the object.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& filename);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    MappedFile(MappedFile&& other) noexcept;
+
+    MappedFile& operator=(MappedFile&& other) noexcept;
+
+    [[nodiscard]] std::span<const std::byte> bytes() const {
+        return {m_data, m_size};
+    }
+
+    [[nodiscard]] std::size_t size() const {
+        return m_size;
+    }
+
+private:
+    void release();
+
+    const std::byte* m_data = nullptr;
+    std::size_t m_size = 0;
+
+    // m_mapped == true if m_data points into a memory mapping that has
+    // to be unmapped, false if it points into m_buffer.
+    bool m_mapped = false;
+    std::vector<std::byte> m_buffer;
+};
+
+}// namespace imp
@@ -0,0 +1,171 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <vector>
+
+#include <iomidipp/Utils.h>
+
+namespace imp {
+
+// MessageBytes -- Byte storage of a MidiMessage.  Messages of up to
+//    inlineCapacity bytes (all channel messages and the common meta
+//    messages such as tempo and time signature) are stored inside the
+//    object itself; only longer meta and sysex payloads go to the heap.
+//    The object has the same size as a std::vector<uchar>.
+//
+//    The bytes can also be borrowed from memory owned by someone else
+//    (see PayloadArena).  Borrowed bytes are copied into owned storage on
+//    the first modification.  Copies always own their bytes, since the
+//    memory borrowed from may not outlive them; moves and share() keep
+//    borrowing.
+class MessageBytes {
+public:
+    using value_type = uchar;
+    using size_type = std::size_t;
+    using iterator = uchar*;
+    using const_iterator = const uchar*;
+
+    static constexpr std::size_t inlineCapacity = 16;
+
+    MessageBytes() noexcept {}
+
+    MessageBytes(std::initializer_list<uchar> bytes);
+
+    MessageBytes(const uchar* bytes, std::size_t count);
+
+    explicit MessageBytes(const std::vector<uchar>& bytes);
+
+    MessageBytes(const MessageBytes& other);
+
+    MessageBytes(MessageBytes&& other) noexcept;
+
+    MessageBytes& operator=(const MessageBytes& other);
+
+    MessageBytes& operator=(MessageBytes&& other) noexcept;
+
+    MessageBytes& operator=(const std::vector<uchar>& bytes);
+
+    ~MessageBytes();
+
+    [[nodiscard]] std::size_t size() const {
+        return m_size;
+    }
+
+    [[nodiscard]] bool empty() const {
+        return m_size == 0;
+    }
+
+    [[nodiscard]] std::size_t capacity() const {
+        return m_capacity;
+    }
+
+    [[nodiscard]] bool isBorrowed() const {
+        return m_capacity == 0;
+    }
+
+    // refer to count bytes owned by someone else, without copying them:
+    void borrow(const uchar* bytes, std::size_t count);
+
+    // copy other, but keep borrowing the bytes other borrows:
+    void share(const MessageBytes& other);
+
+    // copy borrowed bytes into owned storage:
+    void unshare() {
+        if (isBorrowed()) {
+            reallocate(m_size, m_size);
+        }
+    }
+
+    uchar* data() {
+        unshare();
+        return isInline() ? m_inline : m_heap;
+    }
+
+    [[nodiscard]] const uchar* data() const {
+        return isInline() ? m_inline : m_heap;
+    }
+
+    uchar& operator[](std::size_t i) {
+        return data()[i];
+    }
+
+    uchar operator[](std::size_t i) const {
+        return data()[i];
+    }
+
+    // bounds-checked access, throws std::out_of_range like std::vector:
+    uchar& at(std::size_t i);
+
+    [[nodiscard]] uchar at(std::size_t i) const;
+
+    iterator begin() {
+        return data();
+    }
+
+    iterator end() {
+        return data() + m_size;
+    }
+
+    [[nodiscard]] const_iterator begin() const {
+        return data();
+    }
+
+    [[nodiscard]] const_iterator end() const {
+        return data() + m_size;
+    }
+
+    void push_back(uchar value) {
+        if (m_size >= m_capacity) {
+            reallocate(std::max<std::size_t>(m_size + 1, 2 * m_capacity), m_size);
+        }
+        data()[m_size++] = value;
+    }
+
+    void resize(std::size_t count, uchar value = 0);
+
+    void reserve(std::size_t count);
+
+    void assign(const uchar* bytes, std::size_t count);
+
+    void assign(std::size_t count, uchar value);
+
+    void clear() {
+        if (isBorrowed()) {
+            release();
+        }
+        m_size = 0;
+    }
+
+    [[nodiscard]] std::vector<uchar> toVector() const {
+        return {begin(), end()};
+    }
+
+    friend bool operator==(const MessageBytes& a, const MessageBytes& b);
+
+private:
+    [[nodiscard]] bool isInline() const {
+        return m_capacity == inlineCapacity;
+    }
+
+    void reallocate(std::size_t capacity, std::size_t keep);
+
+    void release();
+
+    std::uint32_t m_size = 0;
+    // m_capacity == inlineCapacity for inline storage, larger for an
+    // owned heap block, and 0 for borrowed bytes.
+    std::uint32_t m_capacity = inlineCapacity;
+    union {
+        uchar m_inline[inlineCapacity]{};
+        uchar* m_heap;
+    };
+};
+
+}// namespace imp
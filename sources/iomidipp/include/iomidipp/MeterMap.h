@@ -0,0 +1,84 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <iomidipp/MidiEventList.h>
+
+namespace imp {
+
+// MusicalTime -- Position in bars and beats, all counted from 0.  The
+//    beat unit is the denominator of the time signature (an eighth note
+//    in 6/8), and tick is the offset in ticks inside the beat.
+struct MusicalTime {
+    int bar = 0;
+    int beat = 0;
+    int tick = 0;
+
+    bool operator==(const MusicalTime& other) const = default;
+};
+
+// MeterMap -- Conversion between ticks and bars/beats.  Like the
+//    TempoMap it stores one segment per time signature change: its start
+//    tick, the number of the bar which starts there and the bar and beat
+//    length until the next change.  Lookups in both directions are
+//    binary searches over the segments.
+//
+//    Until the first time signature the meter is 4/4.  A time signature
+//    in the middle of a bar ends that bar early and starts a new one.
+class MeterMap {
+public:
+    struct Segment {
+        int tick;        // first tick of the segment, starts a bar
+        int bar;         // number of the bar starting at tick
+        int numerator;   // beats per bar
+        int denominator; // note value of a beat
+        int ticksPerBeat;
+    };
+
+    explicit MeterMap(int ticksPerQuarterNote = 120);
+
+    // build from the time signature meta messages of an event list in
+    // absolute ticks; events at the same tick are applied in list order.
+    MeterMap(int ticksPerQuarterNote, const MidiEventList& events);
+
+    // set the meter from tick on, until the next time signature.  A
+    // change at the same tick as an existing one replaces it.
+    void setTimeSignature(int tick, int numerator, int denominator);
+
+    void clear();
+
+    [[nodiscard]] int getTicksPerQuarterNote() const {
+        return m_ticksPerQuarterNote;
+    }
+
+    [[nodiscard]] const std::vector<Segment>& getSegments() const {
+        return m_segments;
+    }
+
+    // the segment which contains tick:
+    [[nodiscard]] const Segment& getSegmentAtTick(int tick) const;
+
+    // the segment which contains the start of bar:
+    [[nodiscard]] const Segment& getSegmentAtBar(int bar) const;
+
+    // ticks before 0 are given negative bar numbers:
+    [[nodiscard]] MusicalTime ticksToMusicalTime(int tick) const;
+
+    // beat and tick may be larger than a bar or beat, they are added:
+    [[nodiscard]] int musicalTimeToTicks(const MusicalTime& time) const;
+
+private:
+    // recompute the bar numbers of the segments from index on:
+    void updateBars(std::size_t index);
+
+    int m_ticksPerQuarterNote;
+    // m_segments == sorted by tick and bar, never empty, the first one
+    // starts at tick 0 and bar 0.
+    std::vector<Segment> m_segments;
+};
+
+}// namespace imp
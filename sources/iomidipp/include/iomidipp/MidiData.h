@@ -5,12 +5,18 @@
 
 #pragma once
 
+#include <cstdint>
 #include <fstream>
 #include <istream>
+#include <memory>
+#include <span>
 #include <string>
 #include <vector>
 
+#include <iomidipp/MeterMap.h>
 #include <iomidipp/MidiEventList.h>
+#include <iomidipp/PayloadArena.h>
+#include <iomidipp/TempoMap.h>
 
 #define TIME_STATE_DELTA 0
 #define TIME_STATE_ABSOLUTE 1
@@ -20,16 +26,19 @@
 
 namespace imp {
 
-class TickTime {
-public:
-    int tick;
-    double seconds;
-};
-
 class MidiData {
 public:
     MidiData() = default;
 
+    // copies share the payload arena: their events keep borrowing from it.
+    MidiData(const MidiData& other);
+
+    MidiData(MidiData&& other) = default;
+
+    MidiData& operator=(const MidiData& other);
+
+    MidiData& operator=(MidiData&& other) = default;
+
     // track-related functions:
     std::vector<MidiEventList>& tracks() {
         return _tracks;
@@ -80,7 +89,9 @@ public:
     int getSplitTrack(int index);
 
     // track sorting
-    void sortTracks();
+    // with parallel, the tracks are sorted concurrently on a thread
+    // pool, and large tracks are sorted on several threads:
+    void sortTracks(bool parallel = false);
 
     void markSequence();
 
@@ -108,6 +119,29 @@ public:
 
     void setTPQ(int ticks);
 
+    // SMPTE time base: ticks are subframes of a frame in real time and
+    // tempo messages do not affect the timing.  framesPerSecond is 24,
+    // 25, 29 (29.97 drop-frame) or 30; getTicksPerQuarterNote() gives
+    // framesPerSecond * subframes, the ticks of one second, as in the
+    // tempo map.  For 29.97 it gives 30 * subframes, the ticks of 1.001
+    // seconds.  Throws std::invalid_argument for values which the file
+    // header cannot store.  setTicksPerQuarterNote() switches back to a
+    // tempo-based time base.
+    void setSmpteTimeBase(int framesPerSecond, int subframes);
+
+    bool isSmpteTimeBase() const {
+        return m_smpteFramesPerSecond > 0;
+    }
+
+    // 0 for a tempo-based time base:
+    int getSmpteFramesPerSecond() const {
+        return m_smpteFramesPerSecond;
+    }
+
+    int getSmpteSubframes() const {
+        return m_smpteSubframes;
+    }
+
     int getTimeState() const {
         return _timeState;
     }
@@ -125,6 +159,35 @@ public:
 
     double getAbsoluteTickTime(double starttime);
 
+    // batch versions of the two functions above, for many values at
+    // once (fastest if the input is sorted).  As for TempoMap, the
+    // output must be at least as large as the input:
+    void getTimeInSeconds(std::span<const int> ticks, std::span<double> seconds);
+
+    void getAbsoluteTickTime(std::span<const double> seconds, std::span<double> ticks);
+
+    // exact integer times, without floating-point drift (-1 outside of
+    // the data).  Samples are counted from 0 at tick 0; the sample index
+    // of a tick is the last sample at or before it.
+    std::int64_t getTimeInNanoseconds(int tickvalue);
+
+    std::int64_t getTimeInSamples(int tickvalue, int sampleRate);
+
+    void getTimeInNanoseconds(std::span<const int> ticks, std::span<std::int64_t> nanoseconds);
+
+    void getTimeInSamples(std::span<const int> ticks, int sampleRate, std::span<std::int64_t> samples);
+
+    std::shared_ptr<const TempoMap> getTempoMap();
+
+    // bar/beat positions from the time signatures of all tracks:
+    std::shared_ptr<const MeterMap> getMeterMap();
+
+    // mark the tempo map and the event times from fromTick on, and the
+    // meter map, as out of date; needed after changing tempo or time
+    // signature events through tracks() or getEvent() instead of
+    // addEvent()/deleteEvent().
+    void invalidateTimeMap(int fromTick = 0);
+
     int getFileDurationInTicks();
 
     double getFileDurationInQuarters();
@@ -138,6 +201,18 @@ public:
 
     void clearLinks();
 
+    // the event linked to the given event, nullptr if not linked.  Links
+    // are kept when events are moved, sorted, joined or copied; events
+    // added with addEvent() or insertEvent() are not linked.
+    MidiEvent* getLinkedEvent(int aTrack, int anIndex);
+
+    // unlink the given event and the event linked to it:
+    void unlinkEvent(int aTrack, int anIndex);
+
+    // refresh the durations stored in linked events after editing their
+    // ticks or seconds directly:
+    void updateLinks();
+
     // filename functions:
     void setFilename(const std::string& aname);
 
@@ -151,12 +226,34 @@ public:
 
     MidiEvent addEvent(int aTrack, MidiEvent& mfevent);
 
+    // add events to a sorted track (in absolute ticks) at their place in
+    // eventCompare() order, after the events they are equal to, so that
+    // no sortTracks() is needed afterwards.  The events get new sequence
+    // numbers if the data has them (e.g. after reading a file).
+    MidiEvent insertEvent(int aTrack, const MidiEvent& mfevent);
+
+    // sorts the events on their own and merges them into the track in
+    // linear time:
+    void insertEvents(int aTrack, MidiEventList events);
+
     MidiEvent& getEvent(int aTrack, int anIndex);
 
+    void deleteEvent(int aTrack, int anIndex);
+
     int getNumberOfEvents(int aTrack) const;
 
     void clear();
 
+    // payload arena functions.  Events borrowing from a previous arena
+    // get their own copy of the bytes when the arena is replaced:
+    void setPayloadArena(std::shared_ptr<PayloadArena> arena);
+
+    std::shared_ptr<PayloadArena> getPayloadArena() const {
+        return m_payloadArena;
+    }
+
+    void detachPayloads();
+
     // Meta-event adding convenience functions:
     MidiEvent addMetaEvent(int aTrack, int aTick,
                            int aType,
@@ -176,6 +273,11 @@ protected:
     // in MIDI file track data.
     int m_ticksPerQuarterNote = 120;
 
+    // m_smpteFramesPerSecond, m_smpteSubframes == SMPTE division of the
+    // MIDI file header, or 0 for ticks per quarter note.
+    int m_smpteFramesPerSecond = 0;
+    int m_smpteSubframes = 0;
+
     // _trackState == state variable for whether the tracks
     // are joined or split.
     int _trackState = TRACK_STATE_SPLIT;
@@ -189,27 +291,52 @@ protected:
     // the object.
     std::string _readFileName;
 
-    // _timemapvalid ==
+    // _timemapvalid == true if m_tempoMap, m_timeMapEndTick and the
+    // seconds of all events are up to date.
     bool _timemapvalid = false;
 
-    // m_timemap ==
-    std::vector<TickTime> m_timemap;
+    // m_timeMapDirtyTick == if the time map is not valid: first tick
+    // from which on the tempo map and event times have to be rebuilt.
+    int m_timeMapDirtyTick = 0;
+
+    // m_tempoMap == tempo changes of all tracks, valid together
+    // with _timemapvalid.
+    std::shared_ptr<const TempoMap> m_tempoMap;
+
+    // m_meterMap == time signatures of all tracks, or null if it has
+    // to be rebuilt.
+    std::shared_ptr<const MeterMap> m_meterMap;
+
+    // m_timeMapEndTick == largest tick of any event when the tempo
+    // map was built; time queries after it are out of range.
+    int m_timeMapEndTick = 0;
+
+    // m_nextSequence == sequence number for the next inserted event,
+    // 0 if the events have no sequence numbers and -1 if not known.
+    int m_nextSequence = -1;
 
     // m_linkedEventQ == True if link analysis has been done.
     bool m_linkedEventsQ = false;
 
+    // m_payloadArena == owner of the message bytes which events
+    // borrow (see File::ReadOptions::payloadArena).  Shared by copies
+    // of the MidiData, so their events stay valid as well.
+    std::shared_ptr<PayloadArena> m_payloadArena;
+
 private:
     int makeVLV(uchar* buffer, int number);
 
-    static int ticksearch(const void* A, const void* B);
+    void buildTimeMap();
 
-    static int secondsearch(const void* A, const void* B);
+    void buildMeterMap();
 
-    void buildTimeMap();
+    MidiEvent& appendEvent(MidiEventList& track, const MidiEvent& event);
+
+    void copyTracks(const MidiData& other);
 
-    double linearTickInterpolationAtSecond(double seconds);
+    void updateTimeMapForEvent(MidiEvent& event);
 
-    double linearSecondInterpolationAtTick(int ticktime);
+    int nextSequenceNumber();
 };
 
 }// namespace imp
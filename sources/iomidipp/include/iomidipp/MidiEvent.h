@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 #include <iomidipp/MidiMessage.h>
@@ -23,7 +24,18 @@ public:
 
     MidiEvent(int aTime, int aTrack, std::vector<uchar>& message);
 
-    // functions related to event linking (note-ons to note-offs).
+    // copy other, but keep borrowing the message bytes other borrows
+    // (see MidiMessage::shareContent()):
+    void share(const MidiEvent& other);
+
+    // functions related to event linking (note-ons to note-offs).  A link
+    // is an id shared by the two events rather than a pointer, so it
+    // survives moving, sorting and copying the events.  Each event keeps
+    // the tick and time in seconds of its partner relative to its own
+    // for the duration functions.  unlinkEvent() and linkEvent() only
+    // change the events they are called with; imp::unlinkEvent() and
+    // imp::linkEvents() (or MidiData::unlinkEvent()) also unlink the
+    // previous partners.
     void unlinkEvent();
 
     void linkEvent(MidiEvent* mev);
@@ -32,11 +44,18 @@ public:
 
     bool isLinked() const;
 
-    MidiEvent* getLinkedEvent();
+    // id shared with the linked event, 0 if not linked:
+    std::int64_t getLinkId() const;
 
-    int getTickDuration();
+    bool isLinkedTo(const MidiEvent& mev) const;
 
-    double getDurationInSeconds();
+    int getTickDuration() const;
+
+    double getDurationInSeconds() const;
+
+    // store the tick and seconds of the linked event mev again, after
+    // either of the two changed:
+    void updateLink(const MidiEvent& mev);
 
     int tick{};      // delta or absolute MIDI ticks
     int track{};     // [original] track number of event in MIDI file
@@ -44,7 +63,9 @@ public:
     int seq{};       // sorting sequence number of event
 
 private:
-    MidiEvent* linkedEvent{};// used to match note-ons and note-offs
+    int linkedTickOffset{};       // tick of the linked event minus tick
+    std::int64_t linkId{};        // used to match note-ons and note-offs
+    double linkedSecondsOffset{}; // seconds of the linked event minus seconds
 };
 
 }// namespace imp
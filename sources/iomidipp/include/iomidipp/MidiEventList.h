@@ -6,6 +6,8 @@
 #pragma once
 
 #include <iomidipp/MidiEvent.h>
+#include <array>
+#include <cstddef>
 #include <vector>
 
 namespace imp {
@@ -14,15 +16,46 @@ using MidiEventList = std::vector<MidiEvent>;
 
 void removeEmpties(MidiEventList& list);
 
+// LinkWorkspace -- Scratch memory of linkNotePairs(): the open note-ons
+//    of every channel and key as stacks of event indices in flat arrays,
+//    and the last state of every on/off controller.  Keeping one workspace
+//    for many lists (e.g. all tracks of a file) avoids allocating it for
+//    every list.
+struct LinkWorkspace {
+    void reset(std::size_t events);
+
+    std::array<int, 16 * 128> noteHeads{};      // latest open note-on, or -1
+    std::vector<int> noteNext;                  // next open note-on below it
+    std::array<int, 18 * 16> controllerEvents{};// last on/off switch event
+    std::array<signed char, 18 * 16> controllerStates{};
+};
+
 int linkNotePairs(MidiEventList& list);
 
+int linkNotePairs(MidiEventList& list, LinkWorkspace& workspace);
+
 void clearLinks(MidiEventList& list);
 
+// index of the event linked to list[index], -1 if not linked:
+int findLinkedEvent(const MidiEventList& list, int index);
+
+// store the tick and seconds of linked partners again after changing
+// them:
+void updateLinks(MidiEventList& list);
+
+// unlink list[index] and its partner:
+void unlinkEvent(MidiEventList& list, int index);
+
+// link list[first] and list[second], unlinking their previous partners:
+void linkEvents(MidiEventList& list, int first, int second);
+
 void clearSequence(MidiEventList& list);
 
 int markSequence(MidiEventList& list, int sequence = 1);
 
-void sort(MidiEventList& list);
+// sort by eventCompare(), keeping the order of equal events; with
+// parallel, a large list is sorted on several threads:
+void sort(MidiEventList& list, bool parallel = false);
 
 int eventCompare(MidiEvent const& a, MidiEvent const& b);
 
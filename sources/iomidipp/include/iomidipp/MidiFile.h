@@ -5,17 +5,86 @@
 
 #pragma once
 
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#include <iomidipp/MeterMap.h>
 #include <iomidipp/MidiData.h>
+#include <iomidipp/TempoMap.h>
 
 namespace imp::File {
 
-MidiData read(const std::string& filename);
+struct ReadOptions {
+    // parallelTracks == Scan the MTrk chunk directory first and decode
+    // every track on its own worker thread.  Falls back to the serial
+    // reader if the declared chunk lengths are not consistent.
+    bool parallelTracks = false;
+
+    // payloadArena == Copy the bytes of long meta and sysex messages
+    // into one PayloadArena owned by the MidiData instead of giving
+    // every event its own heap allocation.  The events borrow their
+    // bytes from the arena, which is released together with the last
+    // copy of the MidiData (see MidiData::detachPayloads()).
+    bool payloadArena = false;
+};
+
+struct WriteOptions {
+    // runningStatus == Leave out the status byte of a channel message
+    // if it is the same as the one of the previous channel message in
+    // the track.  Meta and sysex messages cancel running status.
+    bool runningStatus = false;
+
+    // noteOffAsZeroVelocity == Write note-off messages as note-on
+    // messages with velocity 0, so that note-ons and note-offs of a
+    // channel share one running status.  The release velocity is lost.
+    bool noteOffAsZeroVelocity = false;
+};
+
+MidiData read(const std::string& filename, const ReadOptions& options = {});
+
+MidiData read(std::span<const std::byte> buffer, const ReadOptions& options = {});
+
+MidiData read(std::istream& input, const ReadOptions& options = {});
+
+// Timing -- Timing information of a Standard MIDI File, as given by the
+//    MidiData of the file, see readTiming().
+struct Timing {
+    int ticksPerQuarterNote = 0;
+    // SMPTE time base, or 0 for ticks per quarter note:
+    int smpteFramesPerSecond = 0;
+    int smpteSubframes = 0;
+    // tick and time of the end of the longest track:
+    int durationInTicks = 0;
+    double durationInSeconds = 0.0;
+    std::shared_ptr<const TempoMap> tempoMap;
+    std::shared_ptr<const MeterMap> meterMap;
+    // true if a track chunk is missing or malformed; the other fields then
+    // describe the tracks before it and the part of it up to the error:
+    bool failed = false;
+};
+
+// Scan a Standard MIDI File for its tempo, time signature and end-of-
+// track messages only.  Channel messages are skipped by their length
+// and no events are created; data bytes are not validated.  Like the
+// event cursors, throws std::runtime_error only if the header cannot be
+// parsed; errors in the track data are reported by Timing::failed.
+Timing readTiming(const std::string& filename);
+
+Timing readTiming(std::span<const std::byte> buffer);
 
-//bool read(std::istream &instream);
+// The write functions never modify the data; delta times are computed
+// while writing.
+bool write(const std::string& filename, MidiData const& data, const WriteOptions& options = {});
 
-bool write(const std::string& filename, MidiData const& data);
+bool write(std::ostream& out, MidiData const& data, const WriteOptions& options = {});
 
-//bool write(std::ostream &out);
+// serialize into one buffer holding the complete Standard MIDI File:
+std::vector<uchar> writeToBuffer(MidiData const& data, const WriteOptions& options = {});
 
 //    bool writeHex(const std::string &filename,
 //                  int width = 25);
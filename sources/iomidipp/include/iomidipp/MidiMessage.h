@@ -8,6 +8,7 @@
 #include <string>
 #include <vector>
 
+#include <iomidipp/MessageBytes.h>
 #include <iomidipp/Utils.h>
 
 namespace imp {
@@ -49,6 +50,10 @@ public:
         return content[i];
     }
 
+    uchar operator[](int i) const {
+        return content[i];
+    }
+
     [[nodiscard]] std::size_t getSize() const;
 
     int resizeToCommand();
@@ -99,6 +104,26 @@ public:
 
     void setContent(const std::vector<uchar>& otherContent);
 
+    void setContent(const uchar* bytes, std::size_t count);
+
+    // use bytes owned by someone else (e.g. a PayloadArena) as content;
+    // they are copied on the first modification:
+    void borrowContent(const uchar* bytes, std::size_t count);
+
+    bool isContentBorrowed() const {
+        return content.isBorrowed();
+    }
+
+    // copy the content of other, borrowing the bytes other borrows:
+    void shareContent(const MidiMessage& other) {
+        content.share(other.content);
+    }
+
+    // copy borrowed content into storage owned by the message:
+    void detachContent() {
+        content.unshare();
+    }
+
     // message-type convenience functions:
     bool isMetaMessage() const;
 
@@ -197,6 +222,12 @@ public:
 
     double getTempoSPT(int tpq) const;
 
+    // time signature fields, or -1 if the message is not a time
+    // signature; the denominator is the note value (e.g. 8 for 6/8):
+    int getTimeSignatureNumerator() const;
+
+    int getTimeSignatureDenominator() const;
+
     int getMetaType() const;
 
     bool isText() const;
@@ -230,7 +261,8 @@ public:
     void setMetaTempo(double tempo);
 
 private:
-    std::vector<uchar> content = {};
+    // message bytes, stored inline for all but long meta/sysex messages
+    MessageBytes content;
 };
 
 }// namespace imp
@@ -0,0 +1,44 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <vector>
+
+#include <iomidipp/MidiData.h>
+#include <iomidipp/MidiEventList.h>
+#include <iomidipp/Utils.h>
+
+namespace imp {
+
+// NoteRecord -- One note as an interval (piano-roll entry): the times of
+//    its note-on and note-off and the note-on's key, velocity, channel
+//    and track.
+struct NoteRecord {
+    int onsetTick = 0;
+    int offsetTick = 0;
+    double onsetSeconds = 0.0;
+    double offsetSeconds = 0.0;
+    int track = 0; // [original] track number of the note-on
+    uchar key = 0;
+    uchar velocity = 0;
+    uchar channel = 0;
+
+    bool operator==(const NoteRecord&) const = default;
+};
+
+// notes of a list in onset order, paired as by linkNotePairs() but
+// without changing the events.  Ticks are presumed to be absolute, the
+// seconds are taken from the events; notes without a note-off are left
+// out.
+std::vector<NoteRecord> extractNotes(const MidiEventList& list);
+
+// as above, appending to notes and using the scratch memory of workspace:
+void extractNotes(const MidiEventList& list, std::vector<NoteRecord>& notes, LinkWorkspace& workspace);
+
+// notes of all tracks in onset order (by track at the same tick), with
+// absolute ticks and up-to-date times in seconds:
+std::vector<NoteRecord> extractNotes(MidiData& data);
+
+}// namespace imp
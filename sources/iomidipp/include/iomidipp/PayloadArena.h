@@ -0,0 +1,52 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <iomidipp/Utils.h>
+
+namespace imp {
+
+// PayloadArena -- Monotonic buffer for message bytes.  Allocations are
+//    carved from large chunks and are never freed one by one; all of
+//    them go away at once when the arena is destroyed.  File::read()
+//    uses an arena for long meta and sysex messages, so that a file
+//    with many lyric or text events needs a handful of allocations
+//    instead of one per event.  allocate() may be called from several
+//    threads.
+class PayloadArena {
+public:
+    static constexpr std::size_t defaultChunkSize = 64 * 1024;
+
+    // chunkSize == size of the first chunk; later chunks grow.
+    explicit PayloadArena(std::size_t chunkSize = defaultChunkSize);
+
+    PayloadArena(const PayloadArena&) = delete;
+
+    PayloadArena& operator=(const PayloadArena&) = delete;
+
+    // returns count bytes which stay valid for the lifetime of the arena:
+    uchar* allocate(std::size_t count);
+
+    // copy count bytes into the arena:
+    const uchar* store(const uchar* bytes, std::size_t count);
+
+    // total number of bytes handed out so far:
+    [[nodiscard]] std::size_t getUsedBytes() const;
+
+private:
+    std::vector<std::unique_ptr<uchar[]>> m_chunks;
+    std::size_t m_chunkSize;
+    uchar* m_next = nullptr;
+    std::size_t m_available = 0;
+    std::size_t m_used = 0;
+    mutable std::mutex m_mutex;
+};
+
+}// namespace imp
@@ -0,0 +1,125 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <iomidipp/MidiEventList.h>
+
+namespace imp {
+
+// TempoMap -- Conversion between ticks and seconds.  Time is a piecewise
+//    linear function of ticks which changes slope at each tempo change,
+//    so the map stores one segment per tempo change: its start tick, the
+//    time in seconds at that tick and the seconds per tick until the
+//    next segment.  Lookups in both directions are binary searches over
+//    the segments, independent of the number of events.
+//
+//    Until the first tempo change the tempo is 120 beats per minute.
+//    Ticks before 0 and after the last segment are extrapolated.  A
+//    TempoMap only depends on the tempo changes and the ticks per
+//    quarter note, so it can be built and shared without a MidiData.
+//
+//    Since tempo is given in integer microseconds per quarter note, the
+//    time at a tick is a rational number with denominator ticks per
+//    quarter.  Each segment keeps its start time exactly in these units,
+//    so integer nanoseconds and sample indices are free of rounding
+//    drift and the same on every machine.
+class TempoMap {
+public:
+    static constexpr int defaultTempoMicroseconds = 500000;
+
+    struct Segment {
+        int tick;                 // first tick of the segment
+        double seconds;           // time in seconds at tick
+        double secondsPerTick;    // slope up to the next segment
+        int microsecondsPerQuarter;
+        std::int64_t timeUnits;   // exact time at tick in microseconds
+                                  // times ticks per quarter note
+    };
+
+    explicit TempoMap(int ticksPerQuarterNote = 120);
+
+    // build from the tempo meta messages of an event list in absolute
+    // ticks; events at the same tick are applied in list order.
+    TempoMap(int ticksPerQuarterNote, const MidiEventList& events);
+
+    // constant rate of framesPerSecond * subframes ticks per second for
+    // an SMPTE time base (framesPerSecond 29 means 29.97).  The result
+    // should not be given any tempo changes.
+    static TempoMap smpte(int framesPerSecond, int subframes);
+
+    // ticks per quarter note of smpte(): a quarter note is one second,
+    // or 1.001 seconds of 30 * subframes ticks for 29.97.
+    static int smpteTicksPerQuarterNote(int framesPerSecond, int subframes);
+
+    // set the tempo from tick on, until the next tempo change.  A change
+    // at the same tick as an existing one replaces it.
+    void setTempo(int tick, int microsecondsPerQuarter);
+
+    // remove all tempo changes at tick or later:
+    void eraseFrom(int tick);
+
+    void clear();
+
+    [[nodiscard]] int getTicksPerQuarterNote() const {
+        return m_ticksPerQuarterNote;
+    }
+
+    [[nodiscard]] const std::vector<Segment>& getSegments() const {
+        return m_segments;
+    }
+
+    // the segment which contains tick:
+    [[nodiscard]] const Segment& getSegmentAtTick(double tick) const;
+
+    // the segment which contains the time in seconds:
+    [[nodiscard]] const Segment& getSegmentAtSeconds(double seconds) const;
+
+    [[nodiscard]] int getTempoMicroseconds(int tick) const {
+        return getSegmentAtTick(tick).microsecondsPerQuarter;
+    }
+
+    [[nodiscard]] double ticksToSeconds(double tick) const;
+
+    [[nodiscard]] double secondsToTicks(double seconds) const;
+
+    // exact time at tick, rounded down to whole nanoseconds:
+    [[nodiscard]] std::int64_t ticksToNanoseconds(int tick) const;
+
+    // index of the sample at or before tick, for a sample rate of up to
+    // 2^28 Hz:
+    [[nodiscard]] std::int64_t ticksToSamples(int tick, int sampleRate) const;
+
+    // batch conversions; the output must have at least the size of the
+    // input, otherwise std::invalid_argument is thrown.  Sorted input is converted run by run: one segment
+    // lookup per run of values inside the same segment, followed by a
+    // plain affine loop over the run.
+    void ticksToSeconds(std::span<const int> ticks, std::span<double> seconds) const;
+
+    void secondsToTicks(std::span<const double> seconds, std::span<double> ticks) const;
+
+    void ticksToNanoseconds(std::span<const int> ticks, std::span<std::int64_t> nanoseconds) const;
+
+    void ticksToSamples(std::span<const int> ticks, int sampleRate, std::span<std::int64_t> samples) const;
+
+private:
+    [[nodiscard]] std::int64_t getTimeUnits(const Segment& segment, int tick) const {
+        return segment.timeUnits + (std::int64_t) (tick - segment.tick) * segment.microsecondsPerQuarter;
+    }
+
+    // recompute the start times of the segments from index on:
+    void updateSeconds(std::size_t index);
+
+    int m_ticksPerQuarterNote;
+    // m_segments == sorted by tick, never empty, the first one starts
+    // at tick 0.
+    std::vector<Segment> m_segments;
+};
+
+}// namespace imp
@@ -0,0 +1,64 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <iomidipp/Utils.h>
+
+namespace imp::File {
+
+// maximum number of bytes of a variable-length value in a Standard MIDI
+// File; the largest value is 0x0fffffff (FF FF FF 7F).
+constexpr std::size_t maxVlvBytes = 4;
+
+// decodeVlv -- Decode the variable-length value starting at pos.
+//    Returns the number of bytes it occupies (1 to 4), or 0 if it is
+//    truncated by end or longer than four bytes.  Whenever four bytes are
+//    available the value is decoded from one big-endian word without a
+//    loop: the position of the first byte without continuation bit gives
+//    the length, and the 7-bit groups are packed with shifts and masks.
+inline std::size_t decodeVlv(const uchar* pos, const uchar* end, ulong& value) {
+    if (pos < end && pos[0] < 0x80) {
+        // single-byte values are by far the most common delta times
+        value = pos[0];
+        return 1;
+    }
+    if (end - pos >= (std::ptrdiff_t) maxVlvBytes) {
+        std::uint32_t word = ((std::uint32_t) pos[0] << 24) | ((std::uint32_t) pos[1] << 16) |
+                             ((std::uint32_t) pos[2] << 8) | (std::uint32_t) pos[3];
+        std::uint32_t stops = ~word & 0x80808080u;
+        if (stops == 0) {
+            return 0;
+        }
+        // stops != 0, so the count is at most 31 and the length 1..4
+        std::size_t length = (std::size_t) std::countl_zero(stops) / 8 + 1;
+        std::uint32_t bits = (word >> (8 * (maxVlvBytes - length))) & 0x7f7f7f7fu;
+        value = (bits & 0x7fu) | ((bits >> 1) & 0x3f80u) | ((bits >> 2) & 0x1fc000u) | ((bits >> 3) & 0xfe00000u);
+        return length;
+    }
+    // near the end of the buffer: plain loop with bounds checks
+    value = 0;
+    for (std::size_t i = 0; i < maxVlvBytes && pos + i < end; i++) {
+        value = (value << 7) | (pos[i] & 0x7f);
+        if (pos[i] < 0x80) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// decodeDeltaTimes -- Decode the delta times of all events in the event
+//    data of one MTrk chunk and append the absolute tick of each event to
+//    ticks.  Message bodies are skipped by their length only, without
+//    being decoded.  Stops after the end-of-track message.  Returns false
+//    if the data is malformed; the ticks decoded so far are kept.
+bool decodeDeltaTimes(std::span<const uchar> chunk, std::vector<int>& ticks);
+
+}// namespace imp::File
@@ -0,0 +1,131 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <iomidipp/ColumnarTrack.h>
+
+namespace imp {
+
+// channelMessageSize -- number of bytes of a channel message with the
+//    given status byte, or 0 if the status byte is not a channel status.
+static std::size_t channelMessageSize(int status) {
+    switch (status & 0xf0) {
+        case 0x80:// Note Off
+        case 0x90:// Note On
+        case 0xA0:// Aftertouch
+        case 0xB0:// Continuous Controller
+        case 0xE0:// Pitch Bend
+            return 3;
+        case 0xC0:// Patch Change
+        case 0xD0:// Channel Pressure
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+ColumnarTrack::ColumnarTrack(const MidiEventList& list) {
+    reserve(list.size());
+    for (auto const& event : list) {
+        push_back(event);
+    }
+}
+
+// ColumnarTrack::toEventList -- Rebuild the MidiEvents of the track.
+MidiEventList ColumnarTrack::toEventList() const {
+    MidiEventList list;
+    list.reserve(size());
+    MidiEvent event;
+    std::vector<uchar> bytes;
+    for (std::size_t i = 0; i < size(); i++) {
+        auto stored = getPayload(i);
+        if (!stored.empty()) {
+            bytes.assign(stored.begin(), stored.end());
+        } else if (status[i] == 0) {
+            bytes.clear();
+        } else if (channelMessageSize(status[i]) == 2) {
+            bytes = {status[i], data1[i]};
+        } else {
+            bytes = {status[i], data1[i], data2[i]};
+        }
+        event.setContent(bytes);
+        event.tick = ticks[i];
+        event.track = tracks[i];
+        event.seq = seqs[i];
+        event.seconds = seconds[i];
+        list.push_back(event);
+    }
+    return list;
+}
+
+void ColumnarTrack::clear() {
+    ticks.clear();
+    tracks.clear();
+    seqs.clear();
+    seconds.clear();
+    status.clear();
+    data1.clear();
+    data2.clear();
+    payloadOffsets.assign(1, 0);
+    payload.clear();
+}
+
+void ColumnarTrack::reserve(std::size_t events) {
+    ticks.reserve(events);
+    tracks.reserve(events);
+    seqs.reserve(events);
+    seconds.reserve(events);
+    status.reserve(events);
+    data1.reserve(events);
+    data2.reserve(events);
+    payloadOffsets.reserve(events + 1);
+}
+
+// ColumnarTrack::push_back -- Append one event to the columns.
+void ColumnarTrack::push_back(const MidiEvent& event) {
+    std::size_t size = event.getSize();
+    ticks.push_back(event.tick);
+    tracks.push_back(event.track);
+    seqs.push_back(event.seq);
+    seconds.push_back(event.seconds);
+    status.push_back(size > 0 ? (uchar) event.getP0() : 0);
+    data1.push_back(size > 1 ? (uchar) event.getP1() : 0);
+    data2.push_back(size > 2 ? (uchar) event.getP2() : 0);
+    if (size > 0 && size != channelMessageSize(event.getP0())) {
+        for (std::size_t i = 0; i < size; i++) {
+            payload.push_back(event[(int) i]);
+        }
+    }
+    payloadOffsets.push_back((std::uint32_t) payload.size());
+}
+
+// ColumnarTrack::getMessageSize -- Returns the size of the MIDI message
+//    of event i, as MidiMessage::getSize() would.
+std::size_t ColumnarTrack::getMessageSize(std::size_t i) const {
+    std::size_t stored = payloadOffsets[i + 1] - payloadOffsets[i];
+    if (stored > 0) {
+        return stored;
+    }
+    return status[i] == 0 ? 0 : channelMessageSize(status[i]);
+}
+
+// ColumnarTrack::findCommand -- Returns the indices of all events with
+//    the given command nibble (and channel, if not negative).  When
+//    searching for note-ons (0x90), events with velocity 0 are skipped
+//    since they are note-offs.
+std::vector<std::size_t> ColumnarTrack::findCommand(int command, int channel) const {
+    std::vector<std::size_t> output;
+    int mask = channel < 0 ? 0xf0 : 0xff;
+    auto wanted = (uchar) ((command & 0xf0) | (channel < 0 ? 0 : channel & 0x0f));
+    bool skipZeroVelocity = (command & 0xf0) == 0x90;
+    const uchar* s = status.data();
+    const uchar* d2 = data2.data();
+    for (std::size_t i = 0; i < status.size(); i++) {
+        if ((s[i] & mask) == wanted && !(skipZeroVelocity && d2[i] == 0)) {
+            output.push_back(i);
+        }
+    }
+    return output;
+}
+
+}// namespace imp
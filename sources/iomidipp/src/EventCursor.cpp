@@ -0,0 +1,407 @@
+/**
+ * @copyright 1999-2020, Craig Stuart Sapp under BSD-2 license
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <utility>
+
+#include <iomidipp/EventCursor.h>
+
+#include "SmfParsing.h"
+
+namespace imp::File {
+
+// MessageView::getP0 -- Return index 0 byte, or -1 if it doesn't exist.
+int MessageView::getP0() const {
+    return getSize() < 1 ? -1 : m_status;
+}
+
+// MessageView::getP1 -- Return index 1 byte, or -1 if it doesn't exist.
+int MessageView::getP1() const {
+    return getSize() < 2 ? -1 : m_payload[0];
+}
+
+// MessageView::getP2 -- Return index 2 byte, or -1 if it doesn't exist.
+int MessageView::getP2() const {
+    return getSize() < 3 ? -1 : m_payload[1];
+}
+
+// MessageView::getCommandNibble -- Returns the top 4 bits of the status
+//    byte, or -1 if the view is empty.
+int MessageView::getCommandNibble() const {
+    return getSize() < 1 ? -1 : m_status & 0xf0;
+}
+
+// MessageView::getChannel -- Returns the bottom 4 bits of the status
+//    byte, or -1 if the view is empty.
+int MessageView::getChannel() const {
+    return getSize() < 1 ? -1 : m_status & 0x0f;
+}
+
+// MessageView::isMeta -- Returns true if the message is a well-formed
+//    meta message (0xff, type and length byte(s)).
+bool MessageView::isMeta() const {
+    return m_status == 0xff && getSize() >= 3;
+}
+
+// MessageView::getMetaType -- returns the meta-message type, or -1 if
+//    the message is not a meta message.
+int MessageView::getMetaType() const {
+    return isMeta() ? m_payload[0] : -1;
+}
+
+// MessageView::isNoteOn -- Returns true if the command nibble is 0x90
+//    and the velocity is non-zero.
+bool MessageView::isNoteOn() const {
+    return getSize() == 3 && (m_status & 0xf0) == 0x90 && m_payload[1] != 0;
+}
+
+// MessageView::isNoteOff -- Returns true if the command nibble is 0x80
+//     or if the command nibble is 0x90 with p2=0 velocity.
+bool MessageView::isNoteOff() const {
+    if (getSize() != 3) {
+        return false;
+    }
+    return (m_status & 0xf0) == 0x80 || ((m_status & 0xf0) == 0x90 && m_payload[1] == 0);
+}
+
+// MessageView::isTempo -- Returns true if message is a meta message
+//      describing tempo (meta message type 0x51).
+bool MessageView::isTempo() const {
+    return getMetaType() == 0x51 && getSize() == 6;
+}
+
+// MessageView::isEndOfTrack -- Returns true if message is a meta message
+//      for end-of-track (meta message type 0x2f).
+bool MessageView::isEndOfTrack() const {
+    return getMetaType() == 0x2f;
+}
+
+// MessageView::toMessage -- Copy the viewed bytes into a MidiMessage.
+MidiMessage MessageView::toMessage() const {
+    if (getSize() == 0) {
+        return {};
+    }
+    MidiMessage::Content content;
+    content.reserve(getSize());
+    content.push_back(m_status);
+    content.insert(content.end(), m_payload.begin(), m_payload.end());
+    return MidiMessage(std::move(content));
+}
+
+// readDataBytes -- Read count MIDI data bytes, which must all be in
+//    the range from 0x00 to 0x7f.
+static bool readDataBytes(ByteReader& input, std::size_t count) {
+    const uchar* data;
+    if (!input.readBytes(data, count)) {
+        return false;
+    }
+    for (std::size_t i = 0; i < count; i++) {
+        if (data[i] > 0x7f) {
+            if (!input.isQuiet()) {
+                std::cerr << "MIDI data byte too large: " << (int) data[i] << std::endl;
+            }
+            return false;
+        }
+    }
+    return true;
+}
+
+// decodeMessage -- Decode one MIDI message (without its delta time)
+//    from the input.  The status byte and a view of the payload bytes
+//    that follow it in a MidiMessage are returned in message.
+//    runningCommand is updated as the message requires.  Errors are
+//    printed unless the input is quiet.
+static bool decodeMessage(ByteReader& input, uchar& runningCommand, MessageView& message) {
+    uchar byte;
+    if (!input.readByte(byte)) {
+        return false;
+    }
+
+    bool runningQ = byte < 0x80;
+    if (runningQ) {
+        if (runningCommand == 0) {
+            if (!input.isQuiet()) {
+                std::cerr << "Error: running command with no previous command" << std::endl;
+            }
+            return false;
+        }
+        if (runningCommand >= 0xf0) {
+            if (!input.isQuiet()) {
+                std::cerr << "Error: running status not permitted with meta and sysex"
+                          << " event." << std::endl;
+                std::cerr << "Byte is 0x" << std::hex << (int) byte << std::dec << std::endl;
+            }
+            return false;
+        }
+    } else {
+        runningCommand = byte;
+    }
+
+    // With running status the first payload byte has just been read as
+    // byte, so the payload starts one byte earlier.
+    const uchar* payload = runningQ ? input.position() - 1 : input.position();
+    std::size_t dataBytes = 0;
+
+    switch (runningCommand & 0xf0) {
+        case 0x80:// note off (2 more bytes)
+        case 0x90:// note on (2 more bytes)
+        case 0xA0:// aftertouch (2 more bytes)
+        case 0xB0:// cont. controller (2 more bytes)
+        case 0xE0:// pitch wheel (2 more bytes)
+            dataBytes = 2;
+            break;
+        case 0xC0:// patch change (1 more byte)
+        case 0xD0:// channel pressure (1 more byte)
+            dataBytes = 1;
+            break;
+        case 0xF0:
+            switch (runningCommand) {
+                case 0xff:// meta event
+                {
+                    // the meta type and VLV length bytes are part of
+                    // the message.
+                    ulong length;
+                    if (!input.readByte(byte) || !readVLValue(input, length)) {
+                        return false;
+                    }
+                    const uchar* data;
+                    if (!input.readBytes(data, length)) {
+                        return false;
+                    }
+                    message = MessageView(runningCommand, {payload, input.position()});
+                    return true;
+                }
+
+                    // The 0xf0 and 0xf7 meta commands deal with system-exclusive
+                    // messages. 0xf0 is used to either start a message or to store
+                    // a complete message.  The 0xf0 is part of the outgoing MIDI
+                    // bytes.  The 0xf7 message is used to send arbitrary bytes,
+                    // typically the middle or ends of system exclusive messages.  The
+                    // 0xf7 byte at the start of the message is not part of the
+                    // outgoing raw MIDI bytes, but is kept in the MidiFile message
+                    // to indicate a raw MIDI byte message (typically a partial
+                    // system exclusive message).  The VLV length is not part
+                    // of the message.
+                case 0xf7:
+                case 0xf0: {
+                    ulong length;
+                    if (!readVLValue(input, length)) {
+                        return false;
+                    }
+                    const uchar* data;
+                    if (!input.readBytes(data, length)) {
+                        return false;
+                    }
+                    message = MessageView(runningCommand, {data, input.position()});
+                    return true;
+                }
+
+                    // other "F" MIDI commands are not expected, and are
+                    // stored without payload.
+                default:
+                    message = MessageView(runningCommand, {});
+                    return true;
+            }
+        default:
+            if (!input.isQuiet()) {
+                std::cout << "Error reading midifile" << std::endl;
+                std::cout << "Command byte was " << (int) runningCommand << std::endl;
+            }
+            return false;
+    }
+
+    if (runningQ) {
+        // first data byte is already read
+        if (!readDataBytes(input, dataBytes - 1)) {
+            return false;
+        }
+    } else if (!readDataBytes(input, dataBytes)) {
+        return false;
+    }
+    message = MessageView(runningCommand, {payload, dataBytes});
+    return true;
+}
+
+// TrackCursor::next -- Decode the next event of the track.  Returns
+//    false once the end-of-track message has been returned, when the
+//    end of the data is reached, or if the data is malformed (see
+//    failed()).
+bool TrackCursor::next(StreamEvent& event) {
+    if (m_done) {
+        return false;
+    }
+    ByteReader input(m_pos, m_end, m_quiet);
+    ulong delta;
+    if (!readVLValue(input, delta) || !decodeMessage(input, m_runningCommand, event.message)) {
+        m_failed = true;
+        m_done = true;
+        return false;
+    }
+    m_pos = input.position();
+    m_tick += (int) delta;
+    event.tick = m_tick;
+    event.track = m_track;
+    m_done = event.message.isEndOfTrack() || m_pos >= m_end;
+    return true;
+}
+
+// skipTrack -- Decode and discard the events of a track starting at
+//    pos, and return the position after its end-of-track message.
+//    Returns nullptr if the track is malformed.
+static const uchar* skipTrack(const uchar* pos, const uchar* end) {
+    TrackCursor cursor(pos, end, 0);
+    StreamEvent event;
+    while (cursor.next(event)) {}
+    return cursor.failed() ? nullptr : cursor.position();
+}
+
+// openTrackChunk -- Read the header of the MTrk chunk at input and
+//    return a cursor over its events.  The chunk length is ignored for
+//    the same reason as in File::read().
+static bool openTrackChunk(ByteReader& input, int track, TrackCursor& cursor) {
+    ulong length;
+    if (!readChunkId(input, "MTrk") || !input.readBigEndian4Bytes(length)) {
+        return false;
+    }
+    cursor = TrackCursor(input.position(), input.position() + input.remaining(), track);
+    return true;
+}
+
+EventCursor::EventCursor(const std::string& filename)
+    : m_file(std::in_place, filename) {
+    open(m_file->bytes());
+}
+
+EventCursor::EventCursor(std::span<const std::byte> buffer) {
+    open(buffer);
+}
+
+// EventCursor::open -- Read the MIDI header.
+void EventCursor::open(std::span<const std::byte> buffer) {
+    if (buffer.empty() || buffer[0] != std::byte{'M'}) {
+        throw std::runtime_error("Bad MIDI data input");
+    }
+    auto begin = reinterpret_cast<const uchar*>(buffer.data());
+    m_end = begin + buffer.size();
+    ByteReader input(begin, m_end);
+    if (!readHeader(input, m_trackCount, m_ticksPerQuarterNote)) {
+        throw std::runtime_error("Bad MIDI data input");
+    }
+    m_track = TrackCursor(input.position(), input.position(), -1);
+}
+
+// EventCursor::next -- Return the next event in file order.  Returns
+//    false after the last event of the last track, or on an error.
+bool EventCursor::next(StreamEvent& event) {
+    while (!m_failed) {
+        if (m_track.next(event)) {
+            return true;
+        }
+        if (m_track.failed()) {
+            m_failed = true;
+            break;
+        }
+        if (m_nextTrack >= m_trackCount) {
+            return false;
+        }
+        ByteReader input(m_track.position(), m_end);
+        if (!openTrackChunk(input, m_nextTrack++, m_track)) {
+            m_failed = true;
+        }
+    }
+    return false;
+}
+
+MergedEventCursor::MergedEventCursor(const std::string& filename)
+    : m_file(std::in_place, filename) {
+    open(m_file->bytes());
+}
+
+MergedEventCursor::MergedEventCursor(std::span<const std::byte> buffer) {
+    open(buffer);
+}
+
+// MergedEventCursor::open -- Read the MIDI header, locate every track
+//    and decode the first event of each.  The track chunks are found
+//    through the declared chunk lengths if these are consistent, and by
+//    skipping over the events of each track otherwise.
+void MergedEventCursor::open(std::span<const std::byte> buffer) {
+    if (buffer.empty() || buffer[0] != std::byte{'M'}) {
+        throw std::runtime_error("Bad MIDI data input");
+    }
+    auto begin = reinterpret_cast<const uchar*>(buffer.data());
+    auto end = begin + buffer.size();
+    ByteReader input(begin, end);
+    int n;
+    if (!readHeader(input, n, m_ticksPerQuarterNote)) {
+        throw std::runtime_error("Bad MIDI data input");
+    }
+
+    m_tracks.resize(n);
+    std::vector<TrackChunk> chunks;
+    if (scanTrackChunks(input.position(), end, n, chunks)) {
+        for (int i = 0; i < n; i++) {
+            m_tracks[i] = TrackCursor(chunks[i].first, chunks[i].second, i);
+        }
+    } else {
+        for (int i = 0; i < n; i++) {
+            if (!openTrackChunk(input, i, m_tracks[i])) {
+                m_failed = true;
+                return;
+            }
+            const uchar* trackEnd = skipTrack(input.position(), end);
+            if (trackEnd == nullptr) {
+                m_failed = true;
+                return;
+            }
+            input.skipTo(trackEnd);
+        }
+    }
+
+    m_pending.resize(n);
+    m_heap.reserve(n);
+    for (int i = 0; i < n; i++) {
+        advance(i);
+    }
+}
+
+// MergedEventCursor::advance -- Decode the next event of a track into
+//    its pending slot and put the track back on the heap.
+void MergedEventCursor::advance(int track) {
+    if (!m_tracks[track].next(m_pending[track])) {
+        m_failed = m_failed || m_tracks[track].failed();
+        return;
+    }
+    m_heap.push_back(track);
+    std::push_heap(m_heap.begin(), m_heap.end(), [this](int a, int b) { return isLater(a, b); });
+}
+
+// MergedEventCursor::isLater -- Heap ordering of the pending events:
+//    true if the pending event of track a comes after that of track b.
+//    std::push_heap builds a max-heap, so this yields the earliest event.
+bool MergedEventCursor::isLater(int a, int b) const {
+    if (m_pending[a].tick != m_pending[b].tick) {
+        return m_pending[a].tick > m_pending[b].tick;
+    }
+    return a > b;
+}
+
+// MergedEventCursor::next -- Return the earliest pending event of all
+//    tracks.  Returns false after the last event, or on an error.
+bool MergedEventCursor::next(StreamEvent& event) {
+    if (m_failed || m_heap.empty()) {
+        return false;
+    }
+    std::pop_heap(m_heap.begin(), m_heap.end(), [this](int a, int b) { return isLater(a, b); });
+    int track = m_heap.back();
+    m_heap.pop_back();
+    event = m_pending[track];
+    advance(track);
+    return true;
+}
+
+}// namespace imp::File
@@ -0,0 +1,100 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define IOMIDIPP_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <iomidipp/MappedFile.h>
+
+namespace imp {
+
+#ifdef IOMIDIPP_HAS_MMAP
+
+MappedFile::MappedFile(const std::string& filename) {
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("file could not be opened");
+    }
+    struct stat info {};
+    if (::fstat(fd, &info) != 0) {
+        ::close(fd);
+        throw std::runtime_error("file could not be opened");
+    }
+    m_size = static_cast<std::size_t>(info.st_size);
+    if (m_size > 0) {
+        void* address = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (address == MAP_FAILED) {
+            ::close(fd);
+            throw std::runtime_error("file could not be mapped");
+        }
+        // the file is parsed front to back exactly once
+        ::madvise(address, m_size, MADV_SEQUENTIAL);
+        m_data = static_cast<const std::byte*>(address);
+        m_mapped = true;
+    }
+    // the mapping stays valid after the descriptor is closed
+    ::close(fd);
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename) {
+    std::ifstream input(filename, std::ios::binary | std::ios::in | std::ios::ate);
+    if (!input.is_open()) {
+        throw std::runtime_error("file could not be opened");
+    }
+    auto length = static_cast<std::size_t>(input.tellg());
+    input.seekg(0, std::ios::beg);
+    m_buffer.resize(length);
+    input.read(reinterpret_cast<char*>(m_buffer.data()), static_cast<std::streamsize>(length));
+    m_data = m_buffer.data();
+    m_size = static_cast<std::size_t>(input.gcount());
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    release();
+}
+
+MappedFile::MappedFile(MappedFile&& other) noexcept
+    : m_data(std::exchange(other.m_data, nullptr))
+    , m_size(std::exchange(other.m_size, 0))
+    , m_mapped(std::exchange(other.m_mapped, false))
+    , m_buffer(std::move(other.m_buffer)) {}
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_data = std::exchange(other.m_data, nullptr);
+        m_size = std::exchange(other.m_size, 0);
+        m_mapped = std::exchange(other.m_mapped, false);
+        m_buffer = std::move(other.m_buffer);
+    }
+    return *this;
+}
+
+// MappedFile::release -- unmap the file or free the buffer holding it.
+void MappedFile::release() {
+#ifdef IOMIDIPP_HAS_MMAP
+    if (m_mapped) {
+        ::munmap(const_cast<std::byte*>(m_data), m_size);
+    }
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_mapped = false;
+    m_buffer.clear();
+}
+
+}// namespace imp
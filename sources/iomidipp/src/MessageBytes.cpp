@@ -0,0 +1,185 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include <iomidipp/MessageBytes.h>
+
+namespace imp {
+
+MessageBytes::MessageBytes(std::initializer_list<uchar> bytes) {
+    assign(bytes.begin(), bytes.size());
+}
+
+MessageBytes::MessageBytes(const uchar* bytes, std::size_t count) {
+    assign(bytes, count);
+}
+
+MessageBytes::MessageBytes(const std::vector<uchar>& bytes) {
+    assign(bytes.data(), bytes.size());
+}
+
+MessageBytes::MessageBytes(const MessageBytes& other) {
+    assign(other.data(), other.size());
+}
+
+MessageBytes::MessageBytes(MessageBytes&& other) noexcept
+    : m_size(other.m_size)
+    , m_capacity(other.m_capacity) {
+    if (other.isInline()) {
+        std::memcpy(m_inline, other.m_inline, m_size);
+    } else {
+        // take over the heap block or the borrowed bytes
+        m_heap = other.m_heap;
+        other.m_capacity = inlineCapacity;
+    }
+    other.m_size = 0;
+}
+
+MessageBytes& MessageBytes::operator=(const MessageBytes& other) {
+    if (this != &other) {
+        assign(other.data(), other.size());
+    }
+    return *this;
+}
+
+MessageBytes& MessageBytes::operator=(MessageBytes&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_size = other.m_size;
+        m_capacity = other.m_capacity;
+        if (other.isInline()) {
+            std::memcpy(m_inline, other.m_inline, m_size);
+        } else {
+            m_heap = other.m_heap;
+            other.m_capacity = inlineCapacity;
+        }
+        other.m_size = 0;
+    }
+    return *this;
+}
+
+MessageBytes& MessageBytes::operator=(const std::vector<uchar>& bytes) {
+    assign(bytes.data(), bytes.size());
+    return *this;
+}
+
+MessageBytes::~MessageBytes() {
+    release();
+}
+
+// MessageBytes::borrow -- Refer to bytes owned by someone else.  The
+//    bytes have to stay valid as long as this object (or a copy of it)
+//    uses them.
+void MessageBytes::borrow(const uchar* bytes, std::size_t count) {
+    release();
+    m_heap = const_cast<uchar*>(bytes);
+    m_size = static_cast<std::uint32_t>(count);
+    m_capacity = 0;
+}
+
+// MessageBytes::share -- Copy other like operator=, but borrow the same
+//    bytes if other borrows them.  Only for owners of the memory the bytes
+//    are borrowed from, which keep it alive for the copy as well.
+void MessageBytes::share(const MessageBytes& other) {
+    if (other.isBorrowed()) {
+        borrow(other.m_heap, other.m_size);
+    } else if (this != &other) {
+        assign(other.data(), other.size());
+    }
+}
+
+// MessageBytes::at -- bounds-checked element access.
+uchar& MessageBytes::at(std::size_t i) {
+    if (i >= m_size) {
+        throw std::out_of_range("MessageBytes::at");
+    }
+    return data()[i];
+}
+
+uchar MessageBytes::at(std::size_t i) const {
+    if (i >= m_size) {
+        throw std::out_of_range("MessageBytes::at");
+    }
+    return data()[i];
+}
+
+// MessageBytes::resize -- change the number of bytes, new bytes are
+//    set to value.
+void MessageBytes::resize(std::size_t count, uchar value) {
+    if (isBorrowed()) {
+        reallocate(std::max<std::size_t>(count, m_size), std::min<std::size_t>(count, m_size));
+    } else if (count > m_capacity) {
+        reallocate(std::max<std::size_t>(count, 2 * m_capacity), m_size);
+    }
+    if (count > m_size) {
+        std::memset(data() + m_size, value, count - m_size);
+    }
+    m_size = static_cast<std::uint32_t>(count);
+}
+
+void MessageBytes::reserve(std::size_t count) {
+    if (isBorrowed() || count > m_capacity) {
+        reallocate(std::max<std::size_t>(count, m_size), m_size);
+    }
+}
+
+// MessageBytes::assign -- replace the content with a copy of the
+//    given bytes.
+void MessageBytes::assign(const uchar* bytes, std::size_t count) {
+    if (isBorrowed()) {
+        release();
+    }
+    m_size = 0;
+    if (count > m_capacity) {
+        reallocate(count, 0);
+    }
+    if (count > 0) {
+        std::memmove(data(), bytes, count);
+    }
+    m_size = static_cast<std::uint32_t>(count);
+}
+
+void MessageBytes::assign(std::size_t count, uchar value) {
+    clear();
+    resize(count, value);
+}
+
+bool operator==(const MessageBytes& a, const MessageBytes& b) {
+    return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin());
+}
+
+// MessageBytes::reallocate -- move the first keep bytes into owned
+//    storage which can hold at least capacity bytes.  Storage never
+//    moves back from the heap to the inline buffer, but borrowed bytes
+//    which fit are copied inline.
+void MessageBytes::reallocate(std::size_t capacity, std::size_t keep) {
+    const uchar* old = isInline() ? m_inline : m_heap;
+    if (capacity <= inlineCapacity) {
+        uchar copy[inlineCapacity];
+        std::memcpy(copy, old, keep);
+        release();
+        std::memcpy(m_inline, copy, keep);
+    } else {
+        auto* block = new uchar[capacity];
+        std::memcpy(block, old, keep);
+        release();
+        m_heap = block;
+        m_capacity = static_cast<std::uint32_t>(capacity);
+    }
+}
+
+// MessageBytes::release -- free the heap block, if any, or drop the
+//    borrowed bytes, and go back to inline storage.  The size is left
+//    unchanged.
+void MessageBytes::release() {
+    if (m_capacity > inlineCapacity) {
+        delete[] m_heap;
+    }
+    m_capacity = inlineCapacity;
+}
+
+}// namespace imp
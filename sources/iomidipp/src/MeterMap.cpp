@@ -0,0 +1,88 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <algorithm>
+
+#include <iomidipp/MeterMap.h>
+
+namespace imp {
+
+MeterMap::MeterMap(int ticksPerQuarterNote)
+    : m_ticksPerQuarterNote(ticksPerQuarterNote) {
+    clear();
+}
+
+MeterMap::MeterMap(int ticksPerQuarterNote, const MidiEventList& events)
+    : MeterMap(ticksPerQuarterNote) {
+    for (const auto& event : events) {
+        if (event.isTimeSignature()) {
+            setTimeSignature(event.tick, event.getTimeSignatureNumerator(), event.getTimeSignatureDenominator());
+        }
+    }
+}
+
+// MeterMap::clear -- back to 4/4 everywhere.
+void MeterMap::clear() {
+    m_segments.clear();
+    m_segments.push_back({0, 0, 4, 4, m_ticksPerQuarterNote});
+}
+
+// MeterMap::setTimeSignature -- Time signatures are usually added in
+//    tick order, which appends a segment in constant time.
+void MeterMap::setTimeSignature(int tick, int numerator, int denominator) {
+    tick = std::max(tick, 0);
+    Segment segment{tick, 0, std::max(numerator, 1), denominator,
+                    std::max(m_ticksPerQuarterNote * 4 / std::max(denominator, 1), 1)};
+    auto it = std::lower_bound(m_segments.begin(), m_segments.end(), tick,
+                               [](const Segment& s, int t) { return s.tick < t; });
+    if (it != m_segments.end() && it->tick == tick) {
+        *it = segment;
+    } else {
+        it = m_segments.insert(it, segment);
+    }
+    updateBars(it - m_segments.begin());
+}
+
+// MeterMap::updateBars -- A bar cut short by the next segment still
+//    counts as a bar.
+void MeterMap::updateBars(std::size_t index) {
+    for (std::size_t i = std::max<std::size_t>(index, 1); i < m_segments.size(); i++) {
+        const Segment& previous = m_segments[i - 1];
+        int ticksPerBar = previous.numerator * previous.ticksPerBeat;
+        int bars = (m_segments[i].tick - previous.tick + ticksPerBar - 1) / ticksPerBar;
+        m_segments[i].bar = previous.bar + bars;
+    }
+}
+
+const MeterMap::Segment& MeterMap::getSegmentAtTick(int tick) const {
+    auto it = std::upper_bound(m_segments.begin() + 1, m_segments.end(), tick,
+                               [](int t, const Segment& s) { return t < s.tick; });
+    return *(it - 1);
+}
+
+const MeterMap::Segment& MeterMap::getSegmentAtBar(int bar) const {
+    auto it = std::upper_bound(m_segments.begin() + 1, m_segments.end(), bar,
+                               [](int b, const Segment& s) { return b < s.bar; });
+    return *(it - 1);
+}
+
+MusicalTime MeterMap::ticksToMusicalTime(int tick) const {
+    const Segment& segment = getSegmentAtTick(tick);
+    int ticksPerBar = segment.numerator * segment.ticksPerBeat;
+    int offset = tick - segment.tick;
+    int bars = offset / ticksPerBar;
+    if (offset % ticksPerBar < 0) {
+        bars--;
+    }
+    int inBar = offset - bars * ticksPerBar;
+    return {segment.bar + bars, inBar / segment.ticksPerBeat, inBar % segment.ticksPerBeat};
+}
+
+int MeterMap::musicalTimeToTicks(const MusicalTime& time) const {
+    const Segment& segment = getSegmentAtBar(time.bar);
+    int ticksPerBar = segment.numerator * segment.ticksPerBeat;
+    return segment.tick + (time.bar - segment.bar) * ticksPerBar + time.beat * segment.ticksPerBeat + time.tick;
+}
+
+}// namespace imp
@@ -8,13 +8,102 @@
 #include <iostream>
 #include <iterator>
 #include <sstream>
+#include <stdexcept>
 #include <string>
+#include <utility>
 #include <vector>
 
 #include <iomidipp/MidiData.h>
 
+#include "Parallel.h"
+
 namespace imp {
 
+namespace {
+
+// MetaChange -- a tempo or time signature message of any track at its
+//    absolute tick.
+struct MetaChange {
+    int tick;
+    int seq;
+    int track;
+    const MidiEvent* event;
+};
+
+// sortMetaChanges -- changes at the same tick are applied in sequence
+//    and track order.
+void sortMetaChanges(std::vector<MetaChange>& changes) {
+    std::stable_sort(changes.begin(), changes.end(), [](const MetaChange& a, const MetaChange& b) {
+        if (a.tick != b.tick) {
+            return a.tick < b.tick;
+        }
+        if (a.seq != 0 && b.seq != 0 && a.seq != b.seq) {
+            return a.seq < b.seq;
+        }
+        return a.track < b.track;
+    });
+}
+
+bool eventLess(const MidiEvent& a, const MidiEvent& b) {
+    return eventCompare(a, b) < 0;
+}
+
+// mergeSortedTracks -- Move the events of all tracks into one list in
+//    eventCompare() order.  Unsorted tracks are sorted first; then the
+//    tracks are merged with a min-heap of track indices.  Events which
+//    compare equal stay in track order, then in list order.
+MidiEventList mergeSortedTracks(std::vector<MidiEventList>& tracks) {
+    std::size_t total = 0;
+    for (auto& track : tracks) {
+        if (!std::is_sorted(track.begin(), track.end(), eventLess)) {
+            imp::sort(track);
+        }
+        total += track.size();
+    }
+
+    std::vector<std::size_t> next(tracks.size(), 0);
+    // std::push_heap builds a max-heap, so isLater yields the track
+    // with the earliest next event.  eventCompare() gives +1 both ways
+    // for e.g. two note-ons at the same tick, so only "less" is used.
+    auto isLater = [&](int a, int b) {
+        const MidiEvent& eventA = tracks[a][next[a]];
+        const MidiEvent& eventB = tracks[b][next[b]];
+        if (eventLess(eventB, eventA)) {
+            return true;
+        }
+        return !eventLess(eventA, eventB) && a > b;
+    };
+    std::vector<int> heap;
+    heap.reserve(tracks.size());
+    for (int i = 0; i < (int) tracks.size(); i++) {
+        if (!tracks[i].empty()) {
+            heap.push_back(i);
+        }
+    }
+    std::make_heap(heap.begin(), heap.end(), isLater);
+
+    MidiEventList joined;
+    joined.reserve(total);
+    while (heap.size() > 1) {
+        std::pop_heap(heap.begin(), heap.end(), isLater);
+        int track = heap.back();
+        joined.push_back(std::move(tracks[track][next[track]++]));
+        if (next[track] < tracks[track].size()) {
+            std::push_heap(heap.begin(), heap.end(), isLater);
+        } else {
+            heap.pop_back();
+        }
+    }
+    if (!heap.empty()) {
+        // the rest of the last track needs no comparisons
+        auto& track = tracks[heap.front()];
+        std::move(track.begin() + next[heap.front()], track.end(), std::back_inserter(joined));
+    }
+    return joined;
+}
+
+}// namespace
+
 // MidiFile::operator[] -- return the event list for the specified track.
 MidiEventList& MidiData::operator[](int aTrack) {
     return _tracks[aTrack];
@@ -51,6 +140,7 @@ void MidiData::markSequence() {
     for (auto& track : _tracks) {
         sequence = imp::markSequence(track, sequence);
     }
+    m_nextSequence = sequence;
 }
 
 // MidiFile::joinTracks -- Interleave the data from all tracks,
@@ -59,7 +149,8 @@ void MidiData::markSequence() {
 //   tracks into separate units again.  The style of the
 //   MidiFile when read from a file is with tracks split.
 //   The original track index is stored in the MidiEvent::track
-//   variable.
+//   variable.  The tracks are sorted on their own and then merged,
+//   which is linear in the number of events for sorted tracks.
 void MidiData::joinTracks() {
     if (getTrackState() == TRACK_STATE_JOINED) {
         return;
@@ -69,29 +160,14 @@ void MidiData::joinTracks() {
         return;
     }
 
-    MidiEventList joinedTrack;
-
-    int messagesum = 0;
-    int length = getNumberOfTracks();
-    int i, j;
-    for (i = 0; i < length; i++) {
-        messagesum += (_tracks[i]).size();
-    }
-    joinedTrack.reserve((int) (messagesum + 32 + messagesum * 0.1));
-
     int oldTimeState = getTickState();
     if (oldTimeState == TIME_STATE_DELTA) {
         makeAbsoluteTicks();
     }
-    for (i = 0; i < length; i++) {
-        for (j = 0; j < (int) _tracks[i].size(); j++) {
-            joinedTrack.push_back(_tracks[i][j]);
-        }
-    }
 
+    MidiEventList joinedTrack = mergeSortedTracks(_tracks);
     _tracks.resize(0);
-    _tracks.push_back(joinedTrack);
-    sortTracks();
+    _tracks.push_back(std::move(joinedTrack));
     if (oldTimeState == TIME_STATE_DELTA) {
         makeDeltaTicks();
     }
@@ -124,11 +200,12 @@ void MidiData::splitTracks() {
         return;
     }
 
-    MidiEventList joinedTrack = _tracks[0];
+    MidiEventList joinedTrack = std::move(_tracks[0]);
+    _tracks[0].clear();
     _tracks.resize(m_trackCount);
     for (i = 0; i < length; i++) {
         int trackValue = joinedTrack[i].track;
-        _tracks[trackValue].push_back(joinedTrack[i]);
+        _tracks[trackValue].push_back(std::move(joinedTrack[i]));
     }
 
     if (oldTimeState == TIME_STATE_DELTA) {
@@ -362,30 +439,17 @@ double MidiData::getFileDurationInSeconds() {
             return -1.0;// something went wrong
         }
     }
-    bool revertToDelta = false;
-    if (isDeltaTicks()) {
-        makeAbsoluteTicks();
-        revertToDelta = true;
-    }
-    const MidiData& mf = *this;
-    double output = 0.0;
-    for (int i = 0; i < mf.getNumberOfTracks(); i++) {
-        if (mf[i].back().seconds > output) {
-            output = mf[i].back().seconds;
-        }
-    }
-    if (revertToDelta) {
-        makeDeltaTicks();
-    }
-    return output;
+    return m_tempoMap->ticksToSeconds(m_timeMapEndTick);
 }
 
 // MidiFile::doTimeAnalysis -- Identify the real-time position of
 //    all events by monitoring the tempo in relations to the tick
-//    times in the file.
+//    times in the file.  Always rebuilds the whole time map, so it also
+//    picks up events changed without invalidateTimeMap().
 //
 
 void MidiData::doTimeAnalysis() {
+    m_timeMapDirtyTick = 0;
     buildTimeMap();
 }
 
@@ -403,25 +467,11 @@ double MidiData::getTimeInSeconds(int tickvalue) {
             return -1.0;// something went wrong
         }
     }
-
-    TickTime key;
-    key.tick = tickvalue;
-    key.seconds = -1;
-
-    void* ptr = bsearch(&key, m_timemap.data(), m_timemap.size(),
-                        sizeof(TickTime), ticksearch);
-
-    if (ptr == nullptr) {
-        // The specific tick value was not found, so do a linear
-        // search for the two tick values which occur before and
-        // after the tick value, and do a linear interpolation of
-        // the time in seconds values to figure out the final
-        // time in seconds.
-        // Since the code is not yet written, kill the program at this point:
-        return linearSecondInterpolationAtTick(tickvalue);
-    } else {
-        return ((TickTime*) ptr)->seconds;
+    // give an error value of -1 if time is out of range of data.
+    if (tickvalue < 0 || tickvalue > m_timeMapEndTick) {
+        return -1.0;// don't try to extrapolate
     }
+    return m_tempoMap->ticksToSeconds(tickvalue);
 }
 
 //////////////////////////////
@@ -435,38 +485,105 @@ double MidiData::getAbsoluteTickTime(double starttime) {
     if (_timemapvalid == 0) {
         buildTimeMap();
         if (_timemapvalid == 0) {
-            if (_timemapvalid == 0) {
-                return -1.0;// something went wrong
-            }
+            return -1.0;// something went wrong
         }
     }
+    // give an error value of -1 if time is out of range of data.
+    if (starttime < 0.0 || starttime > m_tempoMap->ticksToSeconds(m_timeMapEndTick)) {
+        return -1.0;
+    }
+    return m_tempoMap->secondsToTicks(starttime);
+}
 
-    TickTime key;
-    key.tick = -1;
-    key.seconds = starttime;
+// MidiFile::getTimeInSeconds -- convert many tick values at once.  Ticks
+//    outside of the data give -1, as for a single value.
+void MidiData::getTimeInSeconds(std::span<const int> ticks, std::span<double> seconds) {
+    if (_timemapvalid == 0) {
+        buildTimeMap();
+    }
+    m_tempoMap->ticksToSeconds(ticks, seconds);
+    const int endTick = m_timeMapEndTick;
+    for (std::size_t i = 0; i < ticks.size(); i++) {
+        seconds[i] = (ticks[i] < 0) | (ticks[i] > endTick) ? -1.0 : seconds[i];
+    }
+}
 
-    void* ptr = bsearch(&key, m_timemap.data(), m_timemap.size(),
-                        sizeof(TickTime), secondsearch);
+// MidiFile::getAbsoluteTickTime -- convert many times in seconds at once.
+void MidiData::getAbsoluteTickTime(std::span<const double> seconds, std::span<double> ticks) {
+    if (_timemapvalid == 0) {
+        buildTimeMap();
+    }
+    m_tempoMap->secondsToTicks(seconds, ticks);
+    const double endTime = m_tempoMap->ticksToSeconds(m_timeMapEndTick);
+    for (std::size_t i = 0; i < seconds.size(); i++) {
+        ticks[i] = (seconds[i] < 0.0) | (seconds[i] > endTime) ? -1.0 : ticks[i];
+    }
+}
 
-    if (ptr == NULL) {
-        // The specific seconds value was not found, so do a linear
-        // search for the two time values which occur before and
-        // after the given time value, and do a linear interpolation of
-        // the time in tick values to figure out the final time in ticks.
-        return linearTickInterpolationAtSecond(starttime);
-    } else {
-        return ((TickTime*) ptr)->tick;
+// MidiFile::getTimeInNanoseconds -- exact time of a tick, rounded down
+//    to whole nanoseconds.
+std::int64_t MidiData::getTimeInNanoseconds(int tickvalue) {
+    if (_timemapvalid == 0) {
+        buildTimeMap();
     }
+    if (tickvalue < 0 || tickvalue > m_timeMapEndTick) {
+        return -1;
+    }
+    return m_tempoMap->ticksToNanoseconds(tickvalue);
+}
+
+// MidiFile::getTimeInSamples -- index of the sample at the given
+//    sample rate where the event at tickvalue has to be placed.
+std::int64_t MidiData::getTimeInSamples(int tickvalue, int sampleRate) {
+    if (_timemapvalid == 0) {
+        buildTimeMap();
+    }
+    if (tickvalue < 0 || tickvalue > m_timeMapEndTick) {
+        return -1;
+    }
+    return m_tempoMap->ticksToSamples(tickvalue, sampleRate);
+}
+
+void MidiData::getTimeInNanoseconds(std::span<const int> ticks, std::span<std::int64_t> nanoseconds) {
+    if (_timemapvalid == 0) {
+        buildTimeMap();
+    }
+    m_tempoMap->ticksToNanoseconds(ticks, nanoseconds);
+    const int endTick = m_timeMapEndTick;
+    for (std::size_t i = 0; i < ticks.size(); i++) {
+        nanoseconds[i] = (ticks[i] < 0) | (ticks[i] > endTick) ? -1 : nanoseconds[i];
+    }
+}
+
+void MidiData::getTimeInSamples(std::span<const int> ticks, int sampleRate, std::span<std::int64_t> samples) {
+    if (_timemapvalid == 0) {
+        buildTimeMap();
+    }
+    m_tempoMap->ticksToSamples(ticks, sampleRate, samples);
+    const int endTick = m_timeMapEndTick;
+    for (std::size_t i = 0; i < ticks.size(); i++) {
+        samples[i] = (ticks[i] < 0) | (ticks[i] > endTick) ? -1 : samples[i];
+    }
+}
+
+// MidiFile::getTempoMap -- return the tempo map of the data, which is
+//    built from the tempo messages of all tracks if necessary.  The map
+//    is immutable and stays valid after the data changes.
+std::shared_ptr<const TempoMap> MidiData::getTempoMap() {
+    if (_timemapvalid == 0) {
+        buildTimeMap();
+    }
+    return m_tempoMap;
 }
 
 // MidiFile::linkNotePairs --  Link note-ons to note-offs separately
 //     for each track.  Returns the total number of note message pairs
 //     that were linked.
 int MidiData::linkNotePairs() {
-    int i;
+    LinkWorkspace workspace;
     int sum = 0;
-    for (i = 0; i < getNumberOfTracks(); i++) {
-        sum += imp::linkNotePairs(_tracks[i]);
+    for (auto& track : _tracks) {
+        sum += imp::linkNotePairs(track, workspace);
     }
     m_linkedEventsQ = true;
     return sum;
@@ -497,43 +614,102 @@ std::string MidiData::getFilename() const {
 // MidiFile::addEvent --
 MidiEvent MidiData::addEvent(int aTrack, int aTick,
                              std::vector<uchar>& midiData) {
-    _timemapvalid = 0;
     MidiEvent me;
     me.tick = aTick;
     me.track = aTrack;
     me.setContent(midiData);
-    _tracks[aTrack].push_back(me);
+    updateTimeMapForEvent(me);
+    appendEvent(_tracks[aTrack], me);
     return me;
 }
 
 // MidiFile::addEvent -- Some bug here when joinedTracks(), but track==1...
 MidiEvent MidiData::addEvent(MidiEvent& mfevent) {
-    if (getTrackState() == TRACK_STATE_JOINED) {
-        _tracks[0].push_back(mfevent);
-        return _tracks[0].back();
-    } else {
-        _tracks.at(mfevent.track).push_back(mfevent);
-        return _tracks.at(mfevent.track).back();
-    }
+    MidiEventList& track = getTrackState() == TRACK_STATE_JOINED ? _tracks[0] : _tracks.at(mfevent.track);
+    MidiEvent& event = appendEvent(track, mfevent);
+    event.detachContent();
+    updateTimeMapForEvent(event);
+    return event;
 }
 
 // Variant where the track is an input parameter:
 MidiEvent MidiData::addEvent(int aTrack, MidiEvent& mfevent) {
-    if (getTrackState() == TRACK_STATE_JOINED) {
-        _tracks[0].push_back(mfevent);
-        _tracks[0].back().track = aTrack;
-        return _tracks[0].back();
-    } else {
-        _tracks.at(aTrack).push_back(mfevent);
-        _tracks.at(aTrack).back().track = aTrack;
-        return _tracks.at(aTrack).back();
+    MidiEventList& track = getTrackState() == TRACK_STATE_JOINED ? _tracks[0] : _tracks.at(aTrack);
+    MidiEvent& event = appendEvent(track, mfevent);
+    event.track = aTrack;
+    event.detachContent();
+    updateTimeMapForEvent(event);
+    return event;
+}
+
+// MidiFile::insertEvent -- The place is found by binary search.  The
+//    new sequence number is larger than all others, so the event comes
+//    after all events at the same tick, as eventCompare() requires.
+//    The new event is not linked, and the links of the events after it
+//    stay valid without an update.
+MidiEvent MidiData::insertEvent(int aTrack, const MidiEvent& mfevent) {
+    MidiEvent event = mfevent;
+    event.unlinkEvent();
+    if (isDeltaTicks()) {
+        std::cerr << "Warning: Sorted insertion only allowed in absolute tick mode." << std::endl;
+        return addEvent(aTrack, event);
+    }
+    MidiEventList& track = getTrackState() == TRACK_STATE_JOINED ? _tracks[0] : _tracks.at(aTrack);
+    event.track = aTrack;
+    event.seq = nextSequenceNumber();
+    event.detachContent();
+    auto it = track.insert(std::upper_bound(track.begin(), track.end(), event, eventLess), std::move(event));
+    updateTimeMapForEvent(*it);
+    return *it;
+}
+
+// MidiFile::insertEvents -- Sequence numbers are given in the sorted
+//    order of the new events, after those of the existing ones.
+void MidiData::insertEvents(int aTrack, MidiEventList events) {
+    if (isDeltaTicks()) {
+        std::cerr << "Warning: Sorted insertion only allowed in absolute tick mode." << std::endl;
+        for (auto& event : events) {
+            addEvent(aTrack, event);
+        }
+        return;
+    }
+    for (auto& event : events) {
+        event.track = aTrack;
+        event.seq = 0;
+        event.unlinkEvent();
+        event.detachContent();
+    }
+    imp::sort(events);
+
+    MidiEventList& track = getTrackState() == TRACK_STATE_JOINED ? _tracks[0] : _tracks.at(aTrack);
+    std::size_t middle = track.size();
+    track.reserve(middle + events.size());
+    for (auto& event : events) {
+        event.seq = nextSequenceNumber();
+        track.push_back(std::move(event));
+        updateTimeMapForEvent(track.back());
     }
+    std::inplace_merge(track.begin(), track.begin() + middle, track.end(), eventLess);
+}
+
+// MidiFile::nextSequenceNumber -- 0 if the events do not have sequence
+//    numbers, otherwise one more than the largest one so far.
+int MidiData::nextSequenceNumber() {
+    if (m_nextSequence < 0) {
+        int largest = 0;
+        for (const auto& track : _tracks) {
+            for (const auto& event : track) {
+                largest = std::max(largest, event.seq);
+            }
+        }
+        m_nextSequence = largest > 0 ? largest + 1 : 0;
+    }
+    return m_nextSequence > 0 ? m_nextSequence++ : 0;
 }
 
 // MidiFile::addMetaEvent --
 MidiEvent MidiData::addMetaEvent(int aTrack, int aTick, int aType,
                                  std::vector<uchar>& metaData) {
-    _timemapvalid = 0;
     int i;
     int length = (int) metaData.size();
     std::vector<uchar> fulldata;
@@ -620,6 +796,7 @@ void MidiData::deleteTrack(int aTrack) {
     auto it = _tracks.begin();
     std::advance(it, aTrack);
     _tracks.erase(it);
+    invalidateTimeMap(0);
 }
 
 // MidiFile::clear -- make the MIDI file empty with one
@@ -628,9 +805,94 @@ void MidiData::clear() {
     _tracks.clear();
     _tracks.resize(1);
     _timemapvalid = false;
-    m_timemap.clear();
+    m_timeMapDirtyTick = 0;
+    m_tempoMap.reset();
+    m_meterMap.reset();
+    m_nextSequence = -1;
     _trackState = TRACK_STATE_SPLIT;
     _timeState = TIME_STATE_ABSOLUTE;
+    m_payloadArena.reset();
+}
+
+MidiData::MidiData(const MidiData& other)
+    : m_ticksPerQuarterNote(other.m_ticksPerQuarterNote)
+    , m_smpteFramesPerSecond(other.m_smpteFramesPerSecond)
+    , m_smpteSubframes(other.m_smpteSubframes)
+    , _trackState(other._trackState)
+    , _timeState(other._timeState)
+    , _readFileName(other._readFileName)
+    , _timemapvalid(other._timemapvalid)
+    , m_timeMapDirtyTick(other.m_timeMapDirtyTick)
+    , m_tempoMap(other.m_tempoMap)
+    , m_meterMap(other.m_meterMap)
+    , m_timeMapEndTick(other.m_timeMapEndTick)
+    , m_nextSequence(other.m_nextSequence)
+    , m_linkedEventsQ(other.m_linkedEventsQ)
+    , m_payloadArena(other.m_payloadArena) {
+    copyTracks(other);
+}
+
+MidiData& MidiData::operator=(const MidiData& other) {
+    if (this == &other) {
+        return *this;
+    }
+    copyTracks(other);
+    m_ticksPerQuarterNote = other.m_ticksPerQuarterNote;
+    m_smpteFramesPerSecond = other.m_smpteFramesPerSecond;
+    m_smpteSubframes = other.m_smpteSubframes;
+    _trackState = other._trackState;
+    _timeState = other._timeState;
+    _readFileName = other._readFileName;
+    _timemapvalid = other._timemapvalid;
+    m_timeMapDirtyTick = other.m_timeMapDirtyTick;
+    m_tempoMap = other.m_tempoMap;
+    m_meterMap = other.m_meterMap;
+    m_timeMapEndTick = other.m_timeMapEndTick;
+    m_nextSequence = other.m_nextSequence;
+    m_linkedEventsQ = other.m_linkedEventsQ;
+    m_payloadArena = other.m_payloadArena;
+    return *this;
+}
+
+// MidiFile::copyTracks -- Copy the tracks of other.  Copied events
+//    would own their bytes; if other has a payload arena, which is
+//    shared with this object, the events of the copy borrow from it
+//    where the events of other do.
+void MidiData::copyTracks(const MidiData& other) {
+    if (!other.m_payloadArena) {
+        _tracks = other._tracks;
+        return;
+    }
+    _tracks.resize(other._tracks.size());
+    for (std::size_t i = 0; i < _tracks.size(); i++) {
+        _tracks[i].resize(other._tracks[i].size());
+        for (std::size_t j = 0; j < _tracks[i].size(); j++) {
+            _tracks[i][j].share(other._tracks[i][j]);
+        }
+    }
+}
+
+// MidiFile::setPayloadArena -- Keep the arena alive which holds the
+//    bytes borrowed by events of this object.  Events which borrow from
+//    a previous arena get their own copy of the bytes first, since that
+//    arena may be released.
+void MidiData::setPayloadArena(std::shared_ptr<PayloadArena> arena) {
+    if (arena == m_payloadArena) {
+        return;
+    }
+    detachPayloads();
+    m_payloadArena = std::move(arena);
+}
+
+// MidiFile::detachPayloads -- Give every event its own copy of borrowed
+//    message bytes, so that the arena can be released.
+void MidiData::detachPayloads() {
+    for (auto& track : _tracks) {
+        for (auto& event : track) {
+            event.detachContent();
+        }
+    }
+    m_payloadArena.reset();
 }
 
 // MidiFile::getEvent -- return the event at the given index in the
@@ -639,6 +901,41 @@ MidiEvent& MidiData::getEvent(int aTrack, int anIndex) {
     return (_tracks[aTrack])[anIndex];
 }
 
+// MidiFile::deleteEvent -- remove the event at the given index in the
+//    specified track.  Only removing a tempo change (or the last event)
+//    affects the time map.
+void MidiData::deleteEvent(int aTrack, int anIndex) {
+    MidiEventList& track = _tracks.at(aTrack);
+    bool tempo = track.at(anIndex).isTempo() && !isSmpteTimeBase();
+    if (track[anIndex].isTimeSignature()) {
+        m_meterMap.reset();
+    }
+    int tick = track[anIndex].tick;
+    if (track[anIndex].isLinked()) {
+        imp::unlinkEvent(track, anIndex);
+    }
+    track.erase(track.begin() + anIndex);
+    if (isDeltaTicks()) {
+        // the following event keeps its absolute time
+        if (anIndex < (int) track.size()) {
+            track[anIndex].tick += tick;
+        }
+        if (tempo || anIndex == (int) track.size()) {
+            invalidateTimeMap(0);
+        }
+    } else if (tempo) {
+        invalidateTimeMap(tick);
+    } else if (tick >= m_timeMapEndTick) {
+        // the end of the data may have moved
+        m_timeMapEndTick = 0;
+        for (const auto& list : _tracks) {
+            for (const auto& event : list) {
+                m_timeMapEndTick = std::max(m_timeMapEndTick, event.tick);
+            }
+        }
+    }
+}
+
 // MidiFile::getTicksPerQuarterNote -- returns the number of
 //   time units that are supposed to occur during a quarternote.
 int MidiData::getTicksPerQuarterNote() const {
@@ -655,32 +952,50 @@ int MidiData::getNumberOfEvents(int aTrack) const {
 
 void MidiData::setTicksPerQuarterNote(int ticks) {
     m_ticksPerQuarterNote = ticks;
+    m_smpteFramesPerSecond = 0;
+    m_smpteSubframes = 0;
+    invalidateTimeMap(0);
 }
 
 void MidiData::setTPQ(int ticks) {
     setTicksPerQuarterNote(ticks);
 }
 
-// MidiFile::setMillisecondTicks -- set the ticks per quarter note
-//   value to milliseconds.  The format for this specification is
-//   highest 8-bits: SMPTE Frame rate (as a negative 2's compliment value).
-//   lowest 8-bits: divisions per frame (as a positive number).
-//   for millisecond resolution, the SMPTE value is -25, and the
-//   frame rate is 40 frame per division.  In hexadecimal, these
-//   values are: -25 = 1110,0111 = 0xE7 and 40 = 0010,1000 = 0x28
-//   So setting the ticks per quarter note value to 0xE728 will cause
-//   delta times in the MIDI file to represent milliseconds.  Calling
-//   this function will not change any exiting timestamps, it will
-//   only change the meaning of the timestamps.
+// MidiFile::setSmpteTimeBase -- The MIDI file header stores the frame
+//   rate as a negative 2's complement value in the highest 8 bits and
+//   the subframes per frame in the lowest 8 bits, which limits both.
+void MidiData::setSmpteTimeBase(int framesPerSecond, int subframes) {
+    if (framesPerSecond < 1 || framesPerSecond > 128 || subframes < 1 || subframes > 255) {
+        throw std::invalid_argument("MidiData::setSmpteTimeBase: frames per second must be from 1 to 128 "
+                                    "and subframes from 1 to 255");
+    }
+    m_smpteFramesPerSecond = framesPerSecond;
+    m_smpteSubframes = subframes;
+    m_ticksPerQuarterNote = TempoMap::smpteTicksPerQuarterNote(framesPerSecond, subframes);
+    invalidateTimeMap(0);
+}
+
+// MidiFile::setMillisecondTicks -- set the time base to milliseconds.
+//   For millisecond resolution, the SMPTE frame rate is 25 and there
+//   are 40 subframes per frame; in the MIDI file header this is 0xE728.
+//   Calling this function will not change any exiting timestamps, it
+//   will only change the meaning of the timestamps.
 void MidiData::setMillisecondTicks() {
-    m_ticksPerQuarterNote = 0xE728;
+    setSmpteTimeBase(25, 40);
 }
 
-// MidiFile::sortTracks -- sort all tracks in the MidiFile.
-void MidiData::sortTracks() {
+// MidiFile::sortTracks -- sort all tracks in the MidiFile.  With
+//    parallel, the tracks are sorted on the threads of the library's
+//    thread pool, each large track in chunks on several threads.
+void MidiData::sortTracks(bool parallel) {
     if (_timeState == TIME_STATE_ABSOLUTE) {
-        for (int i = 0; i < getNumberOfTracks(); i++) {
-            imp::sort(_tracks.at(i));
+        if (parallel && getNumberOfTracks() > 1) {
+            // a large track is sorted on several threads as well
+            parallelFor(getNumberOfTracks(), [this](int i) { imp::sort(_tracks[i], true); });
+        } else {
+            for (int i = 0; i < getNumberOfTracks(); i++) {
+                imp::sort(_tracks.at(i), parallel);
+            }
         }
     } else {
         std::cerr << "Warning: Sorting only allowed in absolute tick mode.";
@@ -713,231 +1028,187 @@ void MidiData::clearLinks() {
     m_linkedEventsQ = false;
 }
 
-// MidiFile::linearTickInterpolationAtSecond -- return the tick value at the
-//    given input time.
-double MidiData::linearTickInterpolationAtSecond(double seconds) {
-    if (_timemapvalid == 0) {
-        buildTimeMap();
-        if (_timemapvalid == 0) {
-            return -1.0;// something went wrong
-        }
-    }
+// MidiFile::getLinkedEvent -- Returns the event linked to the event at
+//    anIndex in aTrack (usually the note-off of a note-on and vice
+//    versa), or nullptr if it is not linked.
+MidiEvent* MidiData::getLinkedEvent(int aTrack, int anIndex) {
+    int index = imp::findLinkedEvent(_tracks[aTrack], anIndex);
+    return index < 0 ? nullptr : &_tracks[aTrack][index];
+}
 
-    int i;
-    double lasttime = m_timemap[m_timemap.size() - 1].seconds;
-    // give an error value of -1 if time is out of range of data.
-    if (seconds < 0.0) {
-        return -1.0;
-    }
-    if (seconds > m_timemap[m_timemap.size() - 1].seconds) {
-        return -1.0;
+// MidiFile::updateLinks -- Store the tick and seconds of the partner
+//    again in every linked event, for the duration functions.  Moving,
+//    sorting and copying events keeps the durations, and the time
+//    analysis updates the seconds; call it after editing ticks directly
+//    through tracks() or getEvent().
+void MidiData::updateLinks() {
+    for (auto& track : _tracks) {
+        imp::updateLinks(track);
     }
+}
+
+// MidiFile::unlinkEvent -- Unlink the event at anIndex in aTrack and the
+//    event linked to it.
+void MidiData::unlinkEvent(int aTrack, int anIndex) {
+    imp::unlinkEvent(_tracks.at(aTrack), anIndex);
+}
 
-    // Guess which side of the list is closest to target:
-    // Could do a more efficient algorithm since time values are sorted,
-    // but good enough for now...
-    int startindex = -1;
-    if (seconds < lasttime / 2) {
-        for (i = 0; i < (int) m_timemap.size(); i++) {
-            if (m_timemap[i].seconds > seconds) {
-                startindex = i - 1;
-                break;
-            } else if (m_timemap[i].seconds == seconds) {
-                startindex = i;
-                break;
+// MidiFile::appendEvent -- Add a copy of event to the end of track and
+//    return it.  The copy is not linked: it would share the link id of
+//    event and be taken for the partner of event's partner.
+MidiEvent& MidiData::appendEvent(MidiEventList& track, const MidiEvent& event) {
+    track.push_back(event);
+    track.back().unlinkEvent();
+    return track.back();
+}
+
+// MidiFile::buildTimeMap -- build the tempo map from the tempo change
+//      messages of all tracks and fill in the time in seconds of every
+//      event.  If no tempo messages are given (or untill they are given,
+//      then the tempo is set to 120 beats per minute).  The tracks are
+//      neither joined nor converted to absolute ticks: each track is
+//      walked once alongside the tempo segments.  If only the part from
+//      m_timeMapDirtyTick on is out of date, the earlier tempo segments
+//      are kept and only later event times are updated.
+void MidiData::buildTimeMap() {
+    bool deltaTicks = isDeltaTicks();
+    if (isSmpteTimeBase()) {
+        // ticks are real time: no need to look for tempo messages
+        auto tempoMap = std::make_shared<TempoMap>(TempoMap::smpte(m_smpteFramesPerSecond, m_smpteSubframes));
+        const double secondsPerTick = tempoMap->getSegments().front().secondsPerTick;
+        m_timeMapEndTick = 0;
+        for (auto& track : _tracks) {
+            int tick = 0;
+            for (auto& event : track) {
+                tick = deltaTicks ? tick + event.tick : event.tick;
+                m_timeMapEndTick = std::max(m_timeMapEndTick, tick);
+                event.seconds = tick * secondsPerTick;
             }
         }
-    } else {
-        for (i = (int) m_timemap.size() - 1; i > 0; i--) {
-            if (m_timemap[i].seconds < seconds) {
-                startindex = i + 1;
-                break;
-            } else if (m_timemap[i].seconds == seconds) {
-                startindex = i;
-                break;
-            }
+        m_tempoMap = std::move(tempoMap);
+        _timemapvalid = 1;
+        m_timeMapDirtyTick = 0;
+        if (m_linkedEventsQ) {
+            updateLinks();
         }
+        return;
     }
-
-    if (startindex < 0) {
-        return -1.0;
-    }
-    if (startindex >= (int) m_timemap.size() - 1) {
-        return -1.0;
-    }
-
-    double x1 = m_timemap[startindex].seconds;
-    double x2 = m_timemap[startindex + 1].seconds;
-    double y1 = m_timemap[startindex].tick;
-    double y2 = m_timemap[startindex + 1].tick;
-    double xi = seconds;
-
-    return (xi - x1) * ((y2 - y1) / (x2 - x1)) + y1;
-}
-
-// MidiFile::linearSecondInterpolationAtTick -- return the time in seconds
-//    value at the given input tick time. (Ticks input could be made double).
-double MidiData::linearSecondInterpolationAtTick(int ticktime) {
-    if (_timemapvalid == 0) {
-        buildTimeMap();
-        if (_timemapvalid == 0) {
-            return -1.0;// something went wrong
+    int fromTick = m_tempoMap ? m_timeMapDirtyTick : 0;
+
+    // collect the tempo changes of all tracks in time order
+    std::vector<MetaChange> changes;
+    m_timeMapEndTick = 0;
+    for (int i = 0; i < (int) _tracks.size(); i++) {
+        int tick = 0;
+        for (const auto& event : _tracks[i]) {
+            tick = deltaTicks ? tick + event.tick : event.tick;
+            m_timeMapEndTick = std::max(m_timeMapEndTick, tick);
+            if (tick >= fromTick && event.isTempo()) {
+                changes.push_back({tick, event.seq, i, &event});
+            }
         }
     }
-
-    int i;
-    double lasttick = m_timemap[m_timemap.size() - 1].tick;
-    // give an error value of -1 if time is out of range of data.
-    if (ticktime < 0.0) {
-        return -1;
+    sortMetaChanges(changes);
+    // the tempo map may be shared with callers of getTempoMap(), so it
+    // is never changed in place.
+    auto tempoMap = fromTick > 0 ? std::make_shared<TempoMap>(*m_tempoMap)
+                                 : std::make_shared<TempoMap>(getTicksPerQuarterNote());
+    tempoMap->eraseFrom(fromTick);
+    for (const auto& change : changes) {
+        tempoMap->setTempo(change.tick, change.event->getTempoMicroseconds());
     }
-    if (ticktime > m_timemap.back().tick) {
-        return -1;// don't try to extrapolate
-    }
-
-    // Guess which side of the list is closest to target:
-    // Could do a more efficient algorithm since time values are sorted,
-    // but good enough for now...
-    int startindex = -1;
-    if (ticktime < lasttick / 2) {
-        for (i = 0; i < (int) m_timemap.size(); i++) {
-            if (m_timemap[i].tick > ticktime) {
-                startindex = i - 1;
-                break;
-            } else if (m_timemap[i].tick == ticktime) {
-                startindex = i;
-                break;
+
+    // the events of a track are usually sorted, so the segment of the
+    // next event is found by moving forward from the current one.
+    const auto& segments = tempoMap->getSegments();
+    for (auto& track : _tracks) {
+        int tick = 0;
+        std::size_t k = 0;
+        for (auto& event : track) {
+            tick = deltaTicks ? tick + event.tick : event.tick;
+            if (tick < fromTick) {
+                continue;
             }
-        }
-    } else {
-        for (i = (int) m_timemap.size() - 1; i > 0; i--) {
-            if (m_timemap[i].tick < ticktime) {
-                startindex = i;
-                break;
-            } else if (m_timemap[i].tick == ticktime) {
-                startindex = i;
-                break;
+            if (tick < segments[k].tick) {
+                k = &tempoMap->getSegmentAtTick(tick) - segments.data();
+            }
+            while (k + 1 < segments.size() && segments[k + 1].tick <= tick) {
+                k++;
             }
+            event.seconds = segments[k].seconds + (tick - segments[k].tick) * segments[k].secondsPerTick;
         }
     }
+    m_tempoMap = std::move(tempoMap);
 
-    if (startindex < 0) {
-        return -1;
-    }
-    if (startindex >= (int) m_timemap.size() - 1) {
-        return -1;
-    }
-
-    if (m_timemap[startindex].tick == ticktime) {
-        return m_timemap[startindex].seconds;
+    _timemapvalid = 1;
+    m_timeMapDirtyTick = 0;
+    if (m_linkedEventsQ) {
+        updateLinks();
     }
-
-    double x1 = m_timemap[startindex].tick;
-    double x2 = m_timemap[startindex + 1].tick;
-    double y1 = m_timemap[startindex].seconds;
-    double y2 = m_timemap[startindex + 1].seconds;
-    double xi = ticktime;
-
-    return (xi - x1) * ((y2 - y1) / (x2 - x1)) + y1;
 }
 
-// MidiFile::buildTimeMap -- build an index of the absolute tick values
-//      found in a MIDI file, and their corresponding time values in
-//      seconds, taking into consideration tempo change messages.  If no
-//      tempo messages are given (or untill they are given, then the
-//      tempo is set to 120 beats per minute).  If SMPTE time code is
-//      used, then ticks are actually time values.  So don't build
-//      a time map for SMPTE ticks, and just calculate the time in
-//      seconds from the tick value (1000 ticks per second SMPTE
-//      is the only mode tested (25 frames per second and 40 subframes
-//      per frame).
-void MidiData::buildTimeMap() {
-    // convert the MIDI file to absolute time representation
-    // in single track mode (and undo if the MIDI file was not
-    // in that state when this function was called.
-    //
-    int trackstate = getTrackState();
-    int timestate = getTickState();
-
-    makeAbsoluteTicks();
-    joinTracks();
-
-    int allocsize = getNumberOfEvents(0);
-    m_timemap.reserve(allocsize + 10);
-    m_timemap.clear();
-
-    TickTime value;
-
-    int lasttick = 0;
-    int tickinit = 0;
-
-    int i;
-    int tpq = getTicksPerQuarterNote();
-    double defaultTempo = 120.0;
-    double secondsPerTick = 60.0 / (defaultTempo * tpq);
-
-    double lastsec = 0.0;
-    double cursec = 0.0;
-
-    for (i = 0; i < getNumberOfEvents(0); i++) {
-        int curtick = getEvent(0, i).tick;
-        getEvent(0, i).seconds = cursec;
-        if ((curtick > lasttick) || !tickinit) {
-            tickinit = 1;
-
-            // calculate the current time in seconds:
-            cursec = lastsec + (curtick - lasttick) * secondsPerTick;
-            getEvent(0, i).seconds = cursec;
-
-            // store the new tick to second mapping
-            value.tick = curtick;
-            value.seconds = cursec;
-            m_timemap.push_back(value);
-            lasttick = curtick;
-            lastsec = cursec;
-        }
-
-        // update the tempo if needed:
-        if (getEvent(0, i).isTempo()) {
-            secondsPerTick = getEvent(0, i).getTempoSPT(getTicksPerQuarterNote());
+// MidiFile::buildMeterMap -- build the meter map from the time signature
+//      messages of all tracks in one pass.
+void MidiData::buildMeterMap() {
+    bool deltaTicks = isDeltaTicks();
+    std::vector<MetaChange> changes;
+    for (int i = 0; i < (int) _tracks.size(); i++) {
+        int tick = 0;
+        for (const auto& event : _tracks[i]) {
+            tick = deltaTicks ? tick + event.tick : event.tick;
+            if (event.isTimeSignature()) {
+                changes.push_back({tick, event.seq, i, &event});
+            }
         }
     }
-
-    // reset the states of the tracks or time values if necessary here:
-    if (timestate == TIME_STATE_DELTA) {
-        makeDeltaTicks();
+    sortMetaChanges(changes);
+    auto meterMap = std::make_shared<MeterMap>(getTicksPerQuarterNote());
+    for (const auto& change : changes) {
+        meterMap->setTimeSignature(change.tick, change.event->getTimeSignatureNumerator(),
+                                   change.event->getTimeSignatureDenominator());
     }
-    if (trackstate == TRACK_STATE_SPLIT) {
-        splitTracks();
-    }
-
-    _timemapvalid = 1;
+    m_meterMap = std::move(meterMap);
 }
 
-// MidiFile::ticksearch -- for finding a tick entry in the time map.
-int MidiData::ticksearch(const void* A, const void* B) {
-    TickTime& a = *((TickTime*) A);
-    TickTime& b = *((TickTime*) B);
-
-    if (a.tick < b.tick) {
-        return -1;
-    } else if (a.tick > b.tick) {
-        return 1;
+// MidiFile::getMeterMap -- return the meter map of the data, which is
+//    built from the time signatures of all tracks if necessary.  Like
+//    the tempo map it is immutable and can be kept after changes.
+std::shared_ptr<const MeterMap> MidiData::getMeterMap() {
+    if (!m_meterMap) {
+        buildMeterMap();
     }
-    return 0;
+    return m_meterMap;
 }
 
-// MidiFile::secondsearch -- for finding a second entry in the time map.
-int MidiData::secondsearch(const void* A, const void* B) {
-    TickTime& a = *((TickTime*) A);
-    TickTime& b = *((TickTime*) B);
+// MidiFile::invalidateTimeMap -- The next time query rebuilds the tempo
+//    map from fromTick on; the meter map is rebuilt as a whole.
+void MidiData::invalidateTimeMap(int fromTick) {
+    m_meterMap.reset();
+    fromTick = std::max(fromTick, 0);
+    m_timeMapDirtyTick = _timemapvalid ? fromTick : std::min(m_timeMapDirtyTick, fromTick);
+    _timemapvalid = false;
+}
 
-    if (a.seconds < b.seconds) {
-        return -1;
-    } else if (a.seconds > b.seconds) {
-        return 1;
+// MidiFile::updateTimeMapForEvent -- Keep the time map up to date after
+//    an event was added.  Only tempo changes invalidate the map; other
+//    events just get their time in seconds from it.  In delta-tick state
+//    the absolute tick of the event is not known here.  Time signatures
+//    invalidate the meter map.
+void MidiData::updateTimeMapForEvent(MidiEvent& event) {
+    if (event.isTimeSignature()) {
+        m_meterMap.reset();
+    }
+    if (isDeltaTicks()) {
+        invalidateTimeMap(0);
+    } else if (event.isTempo() && !isSmpteTimeBase()) {
+        invalidateTimeMap(event.tick);
+    } else if (_timemapvalid) {
+        event.seconds = m_tempoMap->ticksToSeconds(event.tick);
+        m_timeMapEndTick = std::max(m_timeMapEndTick, event.tick);
+    } else if (m_tempoMap && event.tick < m_timeMapDirtyTick) {
+        // the next rebuild only updates events from the dirty tick on
+        event.seconds = m_tempoMap->ticksToSeconds(event.tick);
     }
-    return 0;
 }
 
 }// namespace imp
@@ -3,6 +3,10 @@
  * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
  */
 
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+
 #include <iomidipp/MidiEvent.h>
 
 namespace imp {
@@ -21,84 +25,95 @@ MidiEvent::MidiEvent(int aTime, int aTrack, std::vector<uchar>& message)
     , track(aTrack)
     , tick(aTime) {}
 
-// MidiEvent::unlinkEvent -- Disassociate this event with another.
-//   Also tell the other event to disassociate from this event.
+// MidiEvent::share -- Copy other like operator=, without copying the
+//   message bytes other borrows from a payload arena.  Only for owners of
+//   the arena, like MidiData.
+void MidiEvent::share(const MidiEvent& other) {
+    shareContent(other);
+    tick = other.tick;
+    track = other.track;
+    seconds = other.seconds;
+    seq = other.seq;
+    linkedTickOffset = other.linkedTickOffset;
+    linkId = other.linkId;
+    linkedSecondsOffset = other.linkedSecondsOffset;
+}
+
+// MidiEvent::unlinkEvent -- Disassociate this event with another.  This
+//   is one-sided: the other event may have moved since the link was made,
+//   so it is not changed and stays linked.  Use imp::unlinkEvent() or
+//   MidiData::unlinkEvent() to unlink both.
 void MidiEvent::unlinkEvent() {
-    if (linkedEvent == nullptr) {
-        return;
-    }
-    MidiEvent* mev = linkedEvent;
-    linkedEvent = nullptr;
-    mev->unlinkEvent();
+    linkId = 0;
+    linkedTickOffset = 0;
+    linkedSecondsOffset = 0.0;
 }
 
-// MidiEvent::linkEvent -- Make a link between two messages.
-//   Unlinking
+// MidiEvent::linkEvent -- Make a link between two messages.  Both events
+//   get a new link id which no other pair of events shares, replacing any
+//   previous links of the two.  As with unlinkEvent(), previous partners
+//   are not changed; imp::linkEvents() unlinks them as well.
 void MidiEvent::linkEvent(MidiEvent* mev) {
-    if (mev->linkedEvent != nullptr) {
-        // unlink other event if it is linked to something else;
-        mev->unlinkEvent();
-    }
-    // if this is already linked to something else, then unlink:
-    if (linkedEvent != nullptr) {
-        linkedEvent->unlinkEvent();
+    if (mev == nullptr || mev == this) {
+        return;
     }
-    unlinkEvent();
-
-    mev->linkedEvent = this;
-    linkedEvent = mev;
+    static std::atomic<std::int64_t> nextLinkId{1};
+    std::int64_t id = nextLinkId.fetch_add(1, std::memory_order_relaxed);
+    linkId = id;
+    mev->linkId = id;
+    updateLink(*mev);
+    mev->updateLink(*this);
 }
 
 void MidiEvent::linkEvent(MidiEvent& mev) {
     linkEvent(&mev);
 }
 
-// MidiEvent::getLinkedEvent -- Returns a linked event.  Usually
-//   this is the note-off message for a note-on message and vice-versa.
-//   Returns null if there are no links.
-MidiEvent* MidiEvent::getLinkedEvent() {
-    return linkedEvent;
+// MidiEvent::isLinked -- Returns true if the event is linked to another
+//   event.
+bool MidiEvent::isLinked() const {
+    return linkId != 0;
 }
 
-// MidiEvent::isLinked -- Returns true if there is an event which is not
-//   nullptr.  This function is similar to getLinkedEvent().
+// MidiEvent::getLinkId -- Returns the id shared by this event and the
+//   event it is linked to, 0 if there is no link.  Usually this pairs a
+//   note-on message with its note-off message.  Copies of an event have
+//   the same id, so the partner has to be looked up in the same list
+//   (see imp::findLinkedEvent()); MidiData::addEvent() and insertEvent()
+//   unlink the copies they add to a track.
+std::int64_t MidiEvent::getLinkId() const {
+    return linkId;
+}
 
-bool MidiEvent::isLinked() const {
-    return linkedEvent == nullptr;
+// MidiEvent::isLinkedTo -- Returns true if mev is the (or a copy of the)
+//   event linked to this one.
+bool MidiEvent::isLinkedTo(const MidiEvent& mev) const {
+    return linkId != 0 && mev.linkId == linkId && &mev != this;
 }
 
 // MidiEvent::getTickDuration --  For linked events (note-ons and note-offs),
 //    return the absolute tick time difference between the two events.
 //    The tick values are presumed to be in absolute tick mode rather than
-//    delta tick mode.  Returns 0 if not linked.
-int MidiEvent::getTickDuration() {
-    MidiEvent* mev = getLinkedEvent();
-    if (mev == nullptr) {
-        return 0;
-    }
-    int tick2 = mev->tick;
-    if (tick2 > tick) {
-        return tick2 - tick;
-    } else {
-        return tick - tick2;
-    }
+//    delta tick mode when the events are linked.  Returns 0 if not linked.
+int MidiEvent::getTickDuration() const {
+    return std::abs(linkedTickOffset);
 }
 
 // MidiEvent::getDurationInSeconds -- For linked events (note-ons and
 //     note-offs), return the duration of the note in seconds.  The
 //     seconds analysis must be done first; otherwise the duration will be
 //     reported as zero.
-double MidiEvent::getDurationInSeconds() {
-    MidiEvent* mev = getLinkedEvent();
-    if (mev == nullptr) {
-        return 0;
-    }
-    double seconds2 = mev->seconds;
-    if (seconds2 > seconds) {
-        return seconds2 - seconds;
-    } else {
-        return seconds - seconds2;
-    }
+double MidiEvent::getDurationInSeconds() const {
+    return std::abs(linkedSecondsOffset);
+}
+
+// MidiEvent::updateLink -- Store the tick and time in seconds of the
+//     linked event mev relative to this event.  The offsets do not change
+//     when the events are moved or copied, only when the tick or seconds
+//     of either event are changed.
+void MidiEvent::updateLink(const MidiEvent& mev) {
+    linkedTickOffset = mev.tick - tick;
+    linkedSecondsOffset = mev.seconds - seconds;
 }
 
 }// namespace imp
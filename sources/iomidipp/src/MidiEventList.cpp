@@ -4,11 +4,17 @@
  */
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
+#include <span>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
 #include <iomidipp/MidiEventList.h>
 
+#include "Parallel.h"
+
 namespace imp {
 
 // removeEmpties -- Remove any MIDI message which contain no
@@ -18,6 +24,58 @@ void removeEmpties(MidiEventList& list) {
     auto _ = std::remove_if(list.begin(), list.end(), [](auto const& event) { return event.isEmpty(); });
 }
 
+namespace {
+
+// controllerSlot -- The following General MIDI controller numbers are
+// also monitored for linking within the track (but not between tracks).
+// hex dec  name                                    range
+// 40  64   Hold pedal (Sustain) on/off             0..63=off  64..127=on
+// 41  65   Portamento on/off                       0..63=off  64..127=on
+// 42  66   Sustenuto Pedal on/off                  0..63=off  64..127=on
+// 43  67   Soft Pedal on/off                       0..63=off  64..127=on
+// 44  68   Legato Pedal on/off                     0..63=off  64..127=on
+// 45  69   Hold Pedal 2 on/off                     0..63=off  64..127=on
+// 50  80   General Purpose Button                  0..63=off  64..127=on
+// 51  81   General Purpose Button                  0..63=off  64..127=on
+// 52  82   General Purpose Button                  0..63=off  64..127=on
+// 53  83   General Purpose Button                  0..63=off  64..127=on
+// 54  84   Undefined on/off                        0..63=off  64..127=on
+// 55  85   Undefined on/off                        0..63=off  64..127=on
+// 56  86   Undefined on/off                        0..63=off  64..127=on
+// 57  87   Undefined on/off                        0..63=off  64..127=on
+// 58  88   Undefined on/off                        0..63=off  64..127=on
+// 59  89   Undefined on/off                        0..63=off  64..127=on
+// 5A  90   Undefined on/off                        0..63=off  64..127=on
+// 7A 122   Local Keyboard On/Off                   0..63=off  64..127=on
+// Returns the slot of an on/off switch controller (0 to 17), or -1.
+constexpr std::array<signed char, 128> controllerSlots = [] {
+    std::array<signed char, 128> slots{};
+    slots.fill(-1);
+    signed char slot = 0;
+    for (int number = 64; number <= 69; number++) {
+        slots[number] = slot++;
+    }
+    for (int number = 80; number <= 90; number++) {
+        slots[number] = slot++;
+    }
+    slots[122] = slot;
+    return slots;
+}();
+
+}// namespace
+
+// LinkWorkspace::reset -- prepare the workspace for linking a list of
+//    the given number of events.  Memory is only allocated if the list
+//    is longer than all lists before.
+void LinkWorkspace::reset(std::size_t events) {
+    noteHeads.fill(-1);
+    if (noteNext.size() < events) {
+        noteNext.resize(events);
+    }
+    controllerEvents.fill(-1);
+    controllerStates.fill(-1);
+}
+
 // linkNotePairs -- Match note-ones and note-offs together
 //   There are two models that can be done if two notes are overlapping
 //   on the same pitch: the first note-off affects the last note-on,
@@ -27,148 +85,63 @@ void removeEmpties(MidiEventList& list) {
 //   track is assumed to be in time-sorted order.  Returns the number
 //   of linked notes (note-on/note-off pairs).
 int linkNotePairs(MidiEventList& list) {
-    // Note-on states:
-    // dimension 1: MIDI channel (0-15)
-    // dimension 2: MIDI key     (0-127)  (but 0 not used for note-ons)
-    // dimension 3: List of active note-ons or note-offs.
-    std::vector<std::vector<std::vector<MidiEvent*>>> noteons;
-    noteons.resize(16);
-    int i;
-    for (i = 0; i < (int) noteons.size(); i++) {
-        noteons[i].resize(128);
-    }
+    LinkWorkspace workspace;
+    return linkNotePairs(list, workspace);
+}
 
-    // Controller linking: The following General MIDI controller numbers are
-    // also monitored for linking within the track (but not between tracks).
-    // hex dec  name                                    range
-    // 40  64   Hold pedal (Sustain) on/off             0..63=off  64..127=on
-    // 41  65   Portamento on/off                       0..63=off  64..127=on
-    // 42  66   Sustenuto Pedal on/off                  0..63=off  64..127=on
-    // 43  67   Soft Pedal on/off                       0..63=off  64..127=on
-    // 44  68   Legato Pedal on/off                     0..63=off  64..127=on
-    // 45  69   Hold Pedal 2 on/off                     0..63=off  64..127=on
-    // 50  80   General Purpose Button                  0..63=off  64..127=on
-    // 51  81   General Purpose Button                  0..63=off  64..127=on
-    // 52  82   General Purpose Button                  0..63=off  64..127=on
-    // 53  83   General Purpose Button                  0..63=off  64..127=on
-    // 54  84   Undefined on/off                        0..63=off  64..127=on
-    // 55  85   Undefined on/off                        0..63=off  64..127=on
-    // 56  86   Undefined on/off                        0..63=off  64..127=on
-    // 57  87   Undefined on/off                        0..63=off  64..127=on
-    // 58  88   Undefined on/off                        0..63=off  64..127=on
-    // 59  89   Undefined on/off                        0..63=off  64..127=on
-    // 5A  90   Undefined on/off                        0..63=off  64..127=on
-    // 7A 122   Local Keyboard On/Off                   0..63=off  64..127=on
-
-    // first keep track of whether the controller is an on/off switch:
-    std::vector<std::pair<int, int>> contmap;
-    contmap.resize(128);
-    std::pair<int, int> zero(0, 0);
-    std::fill(contmap.begin(), contmap.end(), zero);
-    contmap[64].first = 1;
-    contmap[64].second = 0;
-    contmap[65].first = 1;
-    contmap[65].second = 1;
-    contmap[66].first = 1;
-    contmap[66].second = 2;
-    contmap[67].first = 1;
-    contmap[67].second = 3;
-    contmap[68].first = 1;
-    contmap[68].second = 4;
-    contmap[69].first = 1;
-    contmap[69].second = 5;
-    contmap[80].first = 1;
-    contmap[80].second = 6;
-    contmap[81].first = 1;
-    contmap[81].second = 7;
-    contmap[82].first = 1;
-    contmap[82].second = 8;
-    contmap[83].first = 1;
-    contmap[83].second = 9;
-    contmap[84].first = 1;
-    contmap[84].second = 10;
-    contmap[85].first = 1;
-    contmap[85].second = 11;
-    contmap[86].first = 1;
-    contmap[86].second = 12;
-    contmap[87].first = 1;
-    contmap[87].second = 13;
-    contmap[88].first = 1;
-    contmap[88].second = 14;
-    contmap[89].first = 1;
-    contmap[89].second = 15;
-    contmap[90].first = 1;
-    contmap[90].second = 16;
-    contmap[122].first = 1;
-    contmap[122].second = 17;
-
-    // dimensions:
-    // 1: mapped controller (0 to 17)
-    // 2: channel (0 to 15)
-    std::vector<std::vector<MidiEvent*>> contevents;
-    contevents.resize(18);
-    std::vector<std::vector<int>> oldstates;
-    oldstates.resize(18);
-    for (int i = 0; i < 18; i++) {
-        contevents[i].resize(16);
-        std::fill(contevents[i].begin(), contevents[i].end(), nullptr);
-        oldstates[i].resize(16);
-        std::fill(oldstates[i].begin(), oldstates[i].end(), -1);
-    }
+// linkNotePairs -- As above, with the scratch memory of a workspace
+//   which can be reused for many lists.  The active note-ons of each
+//   channel and key form a stack threaded through workspace.noteNext.
+int linkNotePairs(MidiEventList& list, LinkWorkspace& workspace) {
+    workspace.reset(list.size());
+    auto& noteHeads = workspace.noteHeads;
+    auto& noteNext = workspace.noteNext;
+    auto& controllerEvents = workspace.controllerEvents;
+    auto& controllerStates = workspace.controllerStates;
 
     // Now iterate through the MidiEventList keeping track of note and
     // select controller states and linking notes/controllers as needed.
-    int channel;
-    int key;
-    int contnum;
-    int contval;
-    int conti;
-    int contstate;
     int counter = 0;
-    MidiEvent* mev;
-    MidiEvent* noteon;
-    for (i = 0; i < list.size(); i++) {
-        mev = &list.at(i);
-        mev->unlinkEvent();
-        if (mev->isNoteOn()) {
+    for (int i = 0; i < (int) list.size(); i++) {
+        MidiEvent& mev = list[i];
+        mev.unlinkEvent();
+        if (mev.isNoteOn()) {
             // store the note-on to pair later with a note-off message.
-            key = mev->getKeyNumber();
-            channel = mev->getChannel();
-            noteons[channel][key].push_back(mev);
-        } else if (mev->isNoteOff()) {
-            key = mev->getKeyNumber();
-            channel = mev->getChannel();
-            if (noteons[channel][key].size() > 0) {
-                noteon = noteons[channel][key].back();
-                noteons[channel][key].pop_back();
-                noteon->linkEvent(mev);
+            int& head = noteHeads[mev.getChannel() * 128 + (mev.getKeyNumber() & 0x7f)];
+            noteNext[i] = head;
+            head = i;
+        } else if (mev.isNoteOff()) {
+            int& head = noteHeads[mev.getChannel() * 128 + (mev.getKeyNumber() & 0x7f)];
+            if (head >= 0) {
+                MidiEvent& noteon = list[head];
+                head = noteNext[head];
+                noteon.linkEvent(mev);
                 counter++;
             }
-        } else if (mev->isController()) {
-            contnum = mev->getP1();
-            if (contmap[contnum].first) {
-                conti = contmap[contnum].second;
-                channel = mev->getChannel();
-                contval = mev->getP2();
-                contstate = contval < 64 ? 0 : 1;
-                if ((oldstates[conti][channel] == -1) && contstate) {
+        } else if (mev.isController()) {
+            int conti = controllerSlots[mev.getP1() & 0x7f];
+            if (conti >= 0) {
+                int slot = conti * 16 + mev.getChannel();
+                int contstate = mev.getP2() < 64 ? 0 : 1;
+                int oldstate = controllerStates[slot];
+                if ((oldstate == -1) && contstate) {
                     // a newly initialized onstate was detected, so store for
                     // later linking to an off state.
-                    contevents[conti][channel] = mev;
-                    oldstates[conti][channel] = contstate;
-                } else if (oldstates[conti][channel] == contstate) {
+                    controllerEvents[slot] = i;
+                    controllerStates[slot] = (signed char) contstate;
+                } else if (oldstate == contstate) {
                     // the controller state is redundant and will be ignored.
-                } else if ((oldstates[conti][channel] == 0) && contstate) {
+                } else if ((oldstate == 0) && contstate) {
                     // controller is currently off, so store on-state for next link
-                    contevents[conti][channel] = mev;
-                    oldstates[conti][channel] = contstate;
-                } else if ((oldstates[conti][channel] == 1) && (contstate == 0)) {
+                    controllerEvents[slot] = i;
+                    controllerStates[slot] = (signed char) contstate;
+                } else if ((oldstate == 1) && (contstate == 0)) {
                     // controller has just been turned off, so link to
                     // stored on-message.
-                    contevents[conti][channel]->linkEvent(mev);
-                    oldstates[conti][channel] = contstate;
+                    list[controllerEvents[slot]].linkEvent(mev);
+                    controllerStates[slot] = (signed char) contstate;
                     // not necessary, but maybe use for something later:
-                    contevents[conti][channel] = mev;
+                    controllerEvents[slot] = i;
                 }
             }
         }
@@ -176,6 +149,70 @@ int linkNotePairs(MidiEventList& list) {
     return counter;
 }
 
+// findLinkedEvent -- Returns the index of the event linked to the event
+//    at index, or -1 if there is none.  Linked events are usually close to
+//    each other, so the list is searched outwards from index.
+int findLinkedEvent(const MidiEventList& list, int index) {
+    if (index < 0 || index >= (int) list.size() || !list[index].isLinked()) {
+        return -1;
+    }
+    const MidiEvent& event = list[index];
+    int size = (int) list.size();
+    for (int distance = 1; distance < size; distance++) {
+        int after = index + distance;
+        int before = index - distance;
+        if (after < size && event.isLinkedTo(list[after])) {
+            return after;
+        }
+        if (before >= 0 && event.isLinkedTo(list[before])) {
+            return before;
+        }
+        if (after >= size && before < 0) {
+            break;
+        }
+    }
+    return -1;
+}
+
+// updateLinks -- Store the tick and seconds of the partner again in
+//    every linked event of the list, after the ticks or seconds of the
+//    events were changed.  Moving or copying events needs no update.
+//    Only the events still waiting for their partner are kept in the
+//    lookup table, which stays small.
+void updateLinks(MidiEventList& list) {
+    std::unordered_map<std::int64_t, MidiEvent*> open;
+    for (auto& event : list) {
+        if (!event.isLinked()) {
+            continue;
+        }
+        auto found = open.find(event.getLinkId());
+        if (found == open.end()) {
+            open.emplace(event.getLinkId(), &event);
+        } else {
+            found->second->updateLink(event);
+            event.updateLink(*found->second);
+            open.erase(found);
+        }
+    }
+}
+
+// unlinkEvent -- Unlink the event at index and the event linked to it.
+void unlinkEvent(MidiEventList& list, int index) {
+    int partner = findLinkedEvent(list, index);
+    if (partner >= 0) {
+        list[partner].unlinkEvent();
+    }
+    list.at(index).unlinkEvent();
+}
+
+// linkEvents -- Link the events at first and second, after unlinking
+//    them and their previous partners.
+void linkEvents(MidiEventList& list, int first, int second) {
+    unlinkEvent(list, first);
+    unlinkEvent(list, second);
+    list.at(first).linkEvent(list.at(second));
+}
+
 // clearLinks -- remove all note-on/note-off links.
 void clearLinks(MidiEventList& list) {
     for (auto& event : list) {
@@ -211,15 +248,185 @@ int markSequence(MidiEventList& list, int sequence) {
     return sequence;
 }
 
+namespace {
+
+// minimumParallelChunk == smallest number of events sorted by one
+// thread in a parallel sort.
+constexpr std::size_t minimumParallelChunk = 1 << 15;
+
+// SortEntry -- packed sort key of the event at index in the list.
+struct SortEntry {
+    std::uint64_t key;
+    std::uint32_t index;
+};
+
+// orderedBits -- the bits of value as unsigned number in the same order.
+std::uint32_t orderedBits(int value) {
+    return static_cast<std::uint32_t>(value) ^ 0x80000000u;
+}
+
+// classKey -- Order of events at the same tick (and sequence number)
+//    as in eventCompare(): meta messages, other messages, controllers by
+//    number and value, note-offs, note-ons and the end-of-track message
+//    last.  eventCompare() considers a controller equal to e.g. a program
+//    change but not to another controller; the key puts the controllers
+//    after the other messages to make this a consistent order.
+std::uint32_t classKey(const MidiEvent& event) {
+    int p0 = event.getP0();
+    if (p0 == 0xff) {
+        return event.getP1() == 0x2f ? 5u << 20 : 0u;
+    }
+    int command = p0 & 0xf0;
+    if (command == 0x90 && event.getP2() != 0) {
+        return 4u << 20;
+    }
+    if (command == 0x90 || command == 0x80) {
+        return 3u << 20;
+    }
+    if (command == 0xb0) {
+        // getP1()/getP2() are -1 for missing bytes
+        return (2u << 20) | static_cast<std::uint32_t>((event.getP1() + 1) << 9 | (event.getP2() + 1));
+    }
+    return 1u << 20;
+}
+
+// radixSort -- Stable LSD radix sort of the entries by key, one pass
+//    per byte, using buffer (of the same size) as scratch space.  Bytes
+//    which are the same in all keys (such as the high bytes of the
+//    tick) are skipped.
+void radixSort(std::span<SortEntry> entries, std::span<SortEntry> buffer) {
+    std::size_t count = entries.size();
+    if (count < 2) {
+        return;
+    }
+    std::vector<std::array<std::size_t, 256>> histograms(8);
+    for (auto& histogram : histograms) {
+        histogram.fill(0);
+    }
+    for (const auto& entry : entries) {
+        for (int byte = 0; byte < 8; byte++) {
+            histograms[byte][(entry.key >> (8 * byte)) & 0xff]++;
+        }
+    }
+    SortEntry* from = entries.data();
+    SortEntry* to = buffer.data();
+    for (int byte = 0; byte < 8; byte++) {
+        auto& histogram = histograms[byte];
+        if (histogram[(from[0].key >> (8 * byte)) & 0xff] == count) {
+            continue;
+        }
+        std::size_t offset = 0;
+        for (auto& bucket : histogram) {
+            std::size_t size = bucket;
+            bucket = offset;
+            offset += size;
+        }
+        for (std::size_t i = 0; i < count; i++) {
+            to[histogram[(from[i].key >> (8 * byte)) & 0xff]++] = from[i];
+        }
+        std::swap(from, to);
+    }
+    if (from != entries.data()) {
+        std::copy(from, from + count, entries.data());
+    }
+}
+
+// parallelRadixSort -- Radix sort chunks of the entries concurrently,
+//    then merge neighbouring chunks in rounds.  std::merge takes equal
+//    keys from the first chunk first, so the result is the same as that
+//    of a single stable sort.
+void parallelRadixSort(std::vector<SortEntry>& entries) {
+    std::size_t count = entries.size();
+    std::size_t chunks = ThreadPool::instance().size() + 1;
+    chunks = std::min(chunks, count / minimumParallelChunk);
+    std::vector<SortEntry> buffer(count);
+    if (chunks <= 1) {
+        radixSort(entries, buffer);
+        return;
+    }
+    std::vector<std::size_t> bounds(chunks + 1);
+    for (std::size_t i = 0; i <= chunks; i++) {
+        bounds[i] = count * i / chunks;
+    }
+    parallelFor((int) chunks, [&](int i) {
+        std::span<SortEntry> all(entries);
+        std::span<SortEntry> scratch(buffer);
+        radixSort(all.subspan(bounds[i], bounds[i + 1] - bounds[i]),
+                  scratch.subspan(bounds[i], bounds[i + 1] - bounds[i]));
+    });
+    auto keyLess = [](const SortEntry& a, const SortEntry& b) { return a.key < b.key; };
+    for (std::size_t width = 1; width < chunks; width *= 2) {
+        int pairs = (int) ((chunks + 2 * width - 1) / (2 * width));
+        parallelFor(pairs, [&](int pair) {
+            std::size_t first = bounds[2 * width * pair];
+            std::size_t middle = bounds[std::min(2 * width * pair + width, chunks)];
+            std::size_t last = bounds[std::min(2 * width * (pair + 1), chunks)];
+            std::merge(entries.begin() + first, entries.begin() + middle,
+                       entries.begin() + middle, entries.begin() + last,
+                       buffer.begin() + first, keyLess);
+        });
+        entries.swap(buffer);
+    }
+}
+
+}// namespace
+
 // sort -- Private because the MidiFile class keeps
 //    track of delta versus absolute tick states of the MidiEventList,
 //    and sorting is only allowed in absolute tick state (The MidiEventList
 //    does not know about delta/absolute tick states of its contents).
-void sort(MidiEventList& list) {
+//    The order is that of eventCompare(), and events which compare equal
+//    keep their order.  Each event gets a 64-bit key of its tick and
+//    either its sequence number or its classKey(), which is radix
+//    sorted.  Only if some but not all events have a sequence number,
+//    which the key cannot express, eventCompare() itself is used.
+//    With parallel, large lists are sorted in chunks on several threads
+//    with exactly the same result.
+void sort(MidiEventList& list, bool parallel) {
     auto eventLess = [&](MidiEvent const& a, MidiEvent const& b) -> bool {
         return eventCompare(a, b) < 0;
     };
-    std::sort(list.begin(), list.end(), eventLess);
+    std::size_t withSequence = std::count_if(list.begin(), list.end(), [](const MidiEvent& event) { return event.seq != 0; });
+    if (withSequence != 0 && withSequence != list.size()) {
+        std::stable_sort(list.begin(), list.end(), eventLess);
+        return;
+    }
+    if (list.size() < 2) {
+        return;
+    }
+
+    std::vector<SortEntry> entries(list.size());
+    for (std::size_t i = 0; i < list.size(); i++) {
+        std::uint32_t order = withSequence ? orderedBits(list[i].seq) : classKey(list[i]);
+        entries[i] = {(std::uint64_t) orderedBits(list[i].tick) << 32 | order, (std::uint32_t) i};
+    }
+    if (parallel) {
+        parallelRadixSort(entries);
+    } else {
+        std::vector<SortEntry> buffer(entries.size());
+        radixSort(entries, buffer);
+    }
+
+    // events with the same sequence number are ordered by class
+    for (std::size_t i = 0; withSequence && i < entries.size();) {
+        std::size_t end = i + 1;
+        while (end < entries.size() && entries[end].key == entries[i].key) {
+            end++;
+        }
+        if (end - i > 1) {
+            std::stable_sort(entries.begin() + i, entries.begin() + end, [&](const SortEntry& a, const SortEntry& b) {
+                return classKey(list[a.index]) < classKey(list[b.index]);
+            });
+        }
+        i = end;
+    }
+
+    MidiEventList sorted;
+    sorted.reserve(list.size());
+    for (const auto& entry : entries) {
+        sorted.push_back(std::move(list[entry.index]));
+    }
+    list = std::move(sorted);
 }
 
 // eventcompare -- Event comparison function for sorting tracks.
@@ -3,49 +3,24 @@
  * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
  */
 
-#include <iomidipp/MidiFile.h>
+#include <algorithm>
+#include <cassert>
+#include <atomic>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <utility>
 
-namespace imp::File {
+#include <iomidipp/EventCursor.h>
+#include <iomidipp/MappedFile.h>
+#include <iomidipp/MidiFile.h>
+#include <iomidipp/PayloadArena.h>
 
-// MidiFile::readLittleEndian4Bytes -- Read four bytes which are in
-//      little-endian order (smallest byte is first).  Then flip
-//      the order of the bytes to create the return value.
-ulong readLittleEndian4Bytes(std::istream& input) {
-    uchar buffer[4] = {0};
-    input.read((char*) buffer, 4);
-    if (input.eof()) {
-        std::cerr << "Error: unexpected end of file." << std::endl;
-        return 0;
-    }
-    return buffer[3] | (buffer[2] << 8) | (buffer[1] << 16) | (buffer[0] << 24);
-}
+#include "Parallel.h"
+#include "SmfParsing.h"
 
-// MidiFile::readLittleEndian2Bytes -- Read two bytes which are in
-//       little-endian order (smallest byte is first).  Then flip
-//       the order of the bytes to create the return value.
-ushort readLittleEndian2Bytes(std::istream& input) {
-    uchar buffer[2] = {0};
-    input.read((char*) buffer, 2);
-    if (input.eof()) {
-        std::cerr << "Error: unexpected end of file." << std::endl;
-        return 0;
-    }
-    return buffer[1] | (buffer[0] << 8);
-}
-
-// MidiFile::readByte -- Read one byte from input stream.  Set
-//     fail status error if there was a problem (calling function
-//     has to check this status for an error after reading).
-uchar readByte(std::istream& input) {
-    uchar buffer[1] = {0};
-    input.read((char*) buffer, 1);
-    if (input.eof()) {
-        std::cerr << "Error: unexpected end of file." << std::endl;
-        return 0;
-    }
-    return buffer[0];
-}
+namespace imp::File {
 
 std::ostream& writeLittleEndianUShort(std::ostream& out, ushort value) {
     union {
@@ -203,271 +178,53 @@ std::ostream& writeLittleEndianDouble(std::ostream& out, double value) {
     return out;
 }
 
-// MidiFile::unpackVLV -- converts a VLV value to an unsigned long value.
-//     The bytes a, b, c, d, e are in big-endian order (the order they would
-//     be read out of the MIDI file).
-// default values: a = b = c = d = 0;
-ulong unpackVLV(uchar a = 0, uchar b = 0, uchar c = 0, uchar d = 0, uchar e = 0) {
-    uchar bytes[5] = {a, b, c, d, e};
-    int count = 0;
-    while ((count < 5) && (bytes[count] > 0x7f)) {
-        count++;
-    }
-    count++;
-    if (count >= 6) {
-        std::cerr << "VLV number is too large" << std::endl;
-        return 0;
-    }
-
-    ulong output = 0;
-    for (int i = 0; i < count; i++) {
-        output = output << 7;
-        output = output | (bytes[i] & 0x7f);
-    }
-
-    return output;
-}
-
-// MidiFile::readVLValue -- The VLV value is expected to be unpacked into
-//   a 4-byte integer no greater than 0x0fffFFFF, so a VLV value up to
-//   4-bytes in size (FF FF FF 7F) will only be considered.  Longer
-//   VLV values are not allowed in standard MIDI files, so the extract
-//   delta time would be truncated and the extra byte(s) will be parsed
-//   incorrectly as a MIDI command.
-ulong readVLValue(std::istream& input) {
-    uchar b[5] = {0};
-
-    for (int i = 0; i < 5; i++) {
-        b[i] = readByte(input);
-        if (b[i] < 0x80) {
-            break;
-        }
-    }
-
-    return unpackVLV(b[0], b[1], b[2], b[3], b[4]);
-}
-
-// MidiFile::extractMidiData -- Extract MIDI data from input
-//    stream.  Return value is 0 if failure; otherwise, returns 1.
-int extractMidiData(std::istream& input, std::vector<uchar>& array,
-                    uchar& runningCommand) {
-    int character;
-    uchar byte;
-    array.clear();
-    int runningQ;
-
-    character = input.get();
-    if (character == EOF) {
-        std::cerr << "Error: unexpected end of file." << std::endl;
-        return 0;
-    } else {
-        byte = (uchar) character;
+// MidiFile::readChunkId -- Read a four-character chunk identifier
+//    ("MThd" or "MTrk") and compare it to the expected one.
+bool readChunkId(ByteReader& input, const char* expected) {
+    const uchar* id;
+    if (!input.readBytes(id, 4)) {
+        std::cerr << "Expecting '" << expected << "' chunk, but found nothing." << std::endl;
+        return false;
     }
-
-    if (byte < 0x80) {
-        runningQ = 1;
-        if (runningCommand == 0) {
-            std::cerr << "Error: running command with no previous command" << std::endl;
-            return 0;
-        }
-        if (runningCommand >= 0xf0) {
-            std::cerr << "Error: running status not permitted with meta and sysex"
-                      << " event." << std::endl;
-            std::cerr << "Byte is 0x" << std::hex << (int) byte << std::dec << std::endl;
-            return 0;
+    for (int i = 0; i < 4; i++) {
+        if (id[i] != (uchar) expected[i]) {
+            std::cerr << "is not a MIDI file" << std::endl;
+            std::cerr << "Expecting '" << expected[i] << "' at byte " << i + 1
+                      << " of '" << expected << "' chunk but got '"
+                      << (char) id[i] << "'" << std::endl;
+            return false;
         }
-    } else {
-        runningCommand = byte;
-        runningQ = 0;
     }
-
-    array.push_back(runningCommand);
-    if (runningQ) {
-        array.push_back(byte);
-    }
-
-    switch (runningCommand & 0xf0) {
-        case 0x80:// note off (2 more bytes)
-        case 0x90:// note on (2 more bytes)
-        case 0xA0:// aftertouch (2 more bytes)
-        case 0xB0:// cont. controller (2 more bytes)
-        case 0xE0:// pitch wheel (2 more bytes)
-            byte = readByte(input);
-            if (byte > 0x7f) {
-                std::cerr << "MIDI data byte too large: " << (int) byte << std::endl;
-                return {};
-            }
-            array.push_back(byte);
-            if (!runningQ) {
-                byte = readByte(input);
-                if (byte > 0x7f) {
-                    std::cerr << "MIDI data byte too large: " << (int) byte << std::endl;
-                    return {};
-                }
-                array.push_back(byte);
-            }
-            break;
-        case 0xC0:// patch change (1 more byte)
-        case 0xD0:// channel pressure (1 more byte)
-            if (!runningQ) {
-                byte = readByte(input);
-                if (byte > 0x7f) {
-                    std::cerr << "MIDI data byte too large: " << (int) byte << std::endl;
-                    return {};
-                }
-                array.push_back(byte);
-            }
-            break;
-        case 0xF0:
-            switch (runningCommand) {
-                case 0xff:// meta event
-                {
-                    if (!runningQ) {
-                        byte = readByte(input);// meta type
-                        array.push_back(byte);
-                    }
-                    ulong length = 0;
-                    uchar byte1 = 0;
-                    uchar byte2 = 0;
-                    uchar byte3 = 0;
-                    uchar byte4 = 0;
-                    byte1 = readByte(input);
-                    array.push_back(byte1);
-                    if (byte1 >= 0x80) {
-                        byte2 = readByte(input);
-                        array.push_back(byte2);
-                        if (byte2 > 0x80) {
-                            byte3 = readByte(input);
-                            array.push_back(byte3);
-                            if (byte3 >= 0x80) {
-                                byte4 = readByte(input);
-                                array.push_back(byte4);
-                                if (byte4 >= 0x80) {
-                                    std::cerr << "Error: cannot handle large VLVs" << std::endl;
-                                    return {};
-                                } else {
-                                    length = unpackVLV(byte1, byte2, byte3, byte4);
-                                }
-                            } else {
-                                length = unpackVLV(byte1, byte2, byte3);
-                            }
-                        } else {
-                            length = unpackVLV(byte1, byte2);
-                        }
-                    } else {
-                        length = byte1;
-                    }
-                    for (int j = 0; j < (int) length; j++) {
-                        byte = readByte(input);// meta type
-                        array.push_back(byte);
-                    }
-                } break;
-
-                    // The 0xf0 and 0xf7 meta commands deal with system-exclusive
-                    // messages. 0xf0 is used to either start a message or to store
-                    // a complete message.  The 0xf0 is part of the outgoing MIDI
-                    // bytes.  The 0xf7 message is used to send arbitrary bytes,
-                    // typically the middle or ends of system exclusive messages.  The
-                    // 0xf7 byte at the start of the message is not part of the
-                    // outgoing raw MIDI bytes, but is kept in the MidiFile message
-                    // to indicate a raw MIDI byte message (typically a partial
-                    // system exclusive message).
-                case 0xf7:// Raw bytes. 0xf7 is not part of the raw
-                        // bytes, but are included to indicate
-                        // that this is a raw byte message.
-                case 0xf0:// System Exclusive message
-                {         // (complete, or start of message).
-                    int length = (int) readVLValue(input);
-                    for (int i = 0; i < length; i++) {
-                        byte = readByte(input);
-                        array.push_back(byte);
-                    }
-                } break;
-
-                    // other "F" MIDI commands are not expected, but can be
-                    // handled here if they exist.
-            }
-            break;
-        default:
-            std::cout << "Error reading midifile" << std::endl;
-            std::cout << "Command byte was " << (int) runningCommand << std::endl;
-            return 0;
-    }
-    return 1;
+    return true;
 }
 
-MidiData read(std::istream& input) {
-    if (input.peek() != 'M') {
-        throw std::runtime_error("Bad MIDI data input");
-    }
-
-    int character;
-    // uchar  buffer[123456] = {0};
+// MidiFile::readHeader -- Read the MIDI header chunk (4 bytes of ID,
+//    4 byte data size, anticipated 6 bytes of data).  Stores the
+//    number of tracks and the time division.
+bool readHeader(ByteReader& input, int& trackCount, int& ticksPerQuarterNote,
+                int* smpteFramesPerSecond, int* smpteSubframes) {
     ulong longdata;
     ushort shortdata;
 
-    // Read the MIDI header (4 bytes of ID, 4 byte data size,
-    // anticipated 6 bytes of data.
-
-    character = input.get();
-    if (character == EOF) {
-        std::cerr << "unexpected end of file." << std::endl;
-        std::cerr << "Expecting 'M' at first byte, but found nothing." << std::endl;
-        return {};
-    } else if (character != 'M') {
-        std::cerr << "is not a MIDI file" << std::endl;
-        std::cerr << "Expecting 'M' at first byte but got '"
-                  << (char) character << "'" << std::endl;
-        return {};
-    }
-
-    character = input.get();
-    if (character == EOF) {
-        std::cerr << "unexpected end of file." << std::endl;
-        std::cerr << "Expecting 'T' at second byte, but found nothing." << std::endl;
-        return {};
-    } else if (character != 'T') {
-        std::cerr << "is not a MIDI file" << std::endl;
-        std::cerr << "Expecting 'T' at second byte but got '"
-                  << (char) character << "'" << std::endl;
-        return {};
-    }
-
-    character = input.get();
-    if (character == EOF) {
-        std::cerr << "unexpected end of file." << std::endl;
-        std::cerr << "Expecting 'h' at third byte, but found nothing." << std::endl;
-        return {};
-    } else if (character != 'h') {
-        std::cerr << "not a MIDI file" << std::endl;
-        std::cerr << "Expecting 'h' at third byte but got '"
-                  << (char) character << "'" << std::endl;
-        return {};
-    }
-
-    character = input.get();
-    if (character == EOF) {
-        std::cerr << "unexpected end of file." << std::endl;
-        std::cerr << "Expecting 'd' at fourth byte, but found nothing." << std::endl;
-        return {};
-    } else if (character != 'd') {
-        std::cerr << "not a MIDI file" << std::endl;
-        std::cerr << "Expecting 'd' at fourth byte but got '"
-                  << (char) character << "'" << std::endl;
-        return {};
+    if (!readChunkId(input, "MThd")) {
+        return false;
     }
 
     // read header size (allow larger header size?)
-    longdata = readLittleEndian4Bytes(input);
+    if (!input.readBigEndian4Bytes(longdata)) {
+        return false;
+    }
     if (longdata != 6) {
         std::cerr << "Not a MIDI 1.0 Standard MIDI file." << std::endl;
         std::cerr << "The header size is " << longdata << " bytes." << std::endl;
-        return {};
+        return false;
     }
 
     // Header parameter #1: format type
     int type;
-    shortdata = readLittleEndian2Bytes(input);
+    if (!input.readBigEndian2Bytes(shortdata)) {
+        return false;
+    }
     switch (shortdata) {
         case 0:
             type = 0;
@@ -481,25 +238,24 @@ MidiData read(std::istream& input) {
         default:
             std::cerr << "Error: cannot handle a type-" << shortdata
                       << " MIDI file" << std::endl;
-            return {};
+            return false;
     }
 
     // Header parameter #2: track count
-    int n;
-    shortdata = readLittleEndian2Bytes(input);
+    if (!input.readBigEndian2Bytes(shortdata)) {
+        return false;
+    }
     if (type == 0 && shortdata != 1) {
         std::cerr << "Error: Type 0 MIDI file can only contain one track" << std::endl;
         std::cerr << "Instead track count is: " << shortdata << std::endl;
-        return {};
-    } else {
-        n = shortdata;
+        return false;
     }
-
-    MidiData data;
-    data.tracks().resize(n);
+    trackCount = shortdata;
 
     // Header parameter #3: Ticks per quarter note
-    shortdata = readLittleEndian2Bytes(input);
+    if (!input.readBigEndian2Bytes(shortdata)) {
+        return false;
+    }
     if (shortdata >= 0x8000) {
         int framespersecond = 255 - ((shortdata >> 8) & 0x00ff) + 1;
         int subframes = shortdata & 0x00ff;
@@ -520,133 +276,183 @@ MidiData read(std::istream& input) {
                 std::cerr << "Warning: unknown FPS: " << framespersecond << std::endl;
                 std::cerr << "Using non-standard FPS: " << framespersecond << std::endl;
         }
-        data.setTicksPerQuarterNote(framespersecond * subframes);
-
-        // std::cerr << "SMPTE ticks: " << m_ticksPerQuarterNote << " ticks/sec" << std::endl;
-        // std::cerr << "SMPTE frames per second: " << framespersecond << std::endl;
-        // std::cerr << "SMPTE subframes per frame: " << subframes << std::endl;
+        ticksPerQuarterNote = TempoMap::smpteTicksPerQuarterNote(framespersecond, subframes);
+        if (smpteFramesPerSecond) {
+            *smpteFramesPerSecond = framespersecond;
+        }
+        if (smpteSubframes) {
+            *smpteSubframes = subframes;
+        }
     } else {
-        data.setTicksPerQuarterNote(shortdata);
+        ticksPerQuarterNote = shortdata;
+        if (smpteFramesPerSecond) {
+            *smpteFramesPerSecond = 0;
+        }
+        if (smpteSubframes) {
+            *smpteSubframes = 0;
+        }
     }
+    return true;
+}
 
-    // now read individual tracks:
-    uchar runningCommand;
+// MidiFile::readTrackEvents -- Read the events of one track into the
+//    given event list, stopping after the end-of-track meta message or
+//    at the end of the input.  Messages which do not fit into the inline
+//    storage of a MidiMessage are copied into the arena, if one is given.
+//    Errors in the data are printed unless quiet.
+bool readTrackEvents(ByteReader& input, int trackIndex, MidiEventList& track, PayloadArena* arena, bool quiet) {
+    TrackCursor cursor(input.position(), input.position() + input.remaining(), trackIndex, quiet);
+    StreamEvent streamEvent;
     MidiEvent event;
+    uchar shortBytes[MessageBytes::inlineCapacity];
     std::vector<uchar> bytes;
-    int xstatus;
-    // int barline;
+    while (cursor.next(streamEvent)) {
+        auto payload = streamEvent.message.getPayload();
+        std::size_t size = 1 + payload.size();
+        if (size <= MessageBytes::inlineCapacity) {
+            shortBytes[0] = streamEvent.message[0];
+            std::copy(payload.begin(), payload.end(), shortBytes + 1);
+            event.setContent(shortBytes, size);
+        } else if (arena != nullptr) {
+            uchar* target = arena->allocate(size);
+            target[0] = streamEvent.message[0];
+            std::copy(payload.begin(), payload.end(), target + 1);
+            event.borrowContent(target, size);
+        } else {
+            bytes.assign(1, streamEvent.message[0]);
+            bytes.insert(bytes.end(), payload.begin(), payload.end());
+            event.setContent(bytes.data(), size);
+        }
+        event.tick = streamEvent.tick;
+        event.track = trackIndex;
+        track.push_back(std::move(event));
+    }
+    input.skipTo(cursor.position());
+    return !cursor.failed();
+}
+
+// MidiFile::readTrack -- Read one track chunk into the given event
+//    list, stopping after the end-of-track meta message.
+bool readTrack(ByteReader& input, int trackIndex, MidiEventList& track, PayloadArena* arena) {
+    if (!readChunkId(input, "MTrk")) {
+        return false;
+    }
 
-    for (int i = 0; i < n; i++) {
-        runningCommand = 0;
+    // Now read track chunk size and throw it away because it is
+    // not really necessary since the track MUST end with an
+    // end of track meta event, and many MIDI files found in the wild
+    // do not correctly give the track size.
+    ulong longdata;
+    if (!input.readBigEndian4Bytes(longdata)) {
+        return false;
+    }
 
-        // std::cout << "\nReading Track: " << i + 1 << flush;
+    // set the size of the track allocation so that it might
+    // approximately fit the data.
+    track.clear();
+    track.reserve(std::min<std::size_t>(longdata, input.remaining()) / 2);
 
-        // read track header...
+    return readTrackEvents(input, trackIndex, track, arena, false);
+}
 
-        character = input.get();
-        if (character == EOF) {
-            std::cerr << "unexpected end of file." << std::endl;
-            std::cerr << "Expecting 'M' at first byte in track, but found nothing."
-                      << std::endl;
-            return {};
-        } else if (character != 'M') {
-            std::cerr << "is not a MIDI file" << std::endl;
-            std::cerr << "Expecting 'M' at first byte in track but got '"
-                      << (char) character << "'" << std::endl;
-            return {};
+// MidiFile::scanTrackChunks -- Walk the chunk directory by following
+//    the declared MTrk chunk lengths, without decoding any events.
+//    Returns false if the declared lengths cannot be trusted: an ID does
+//    not match, a chunk runs past the end of the buffer, or a chunk does
+//    not end with an end-of-track message.  The chunk list then holds
+//    the event data of each track (without the chunk header).
+bool scanTrackChunks(const uchar* pos, const uchar* end, int trackCount,
+                     std::vector<TrackChunk>& chunks) {
+    chunks.clear();
+    chunks.reserve(trackCount);
+    for (int i = 0; i < trackCount; i++) {
+        if (end - pos < 8 || pos[0] != 'M' || pos[1] != 'T' || pos[2] != 'r' || pos[3] != 'k') {
+            return false;
         }
-
-        character = input.get();
-        if (character == EOF) {
-            std::cerr << "unexpected end of file." << std::endl;
-            std::cerr << "Expecting 'T' at second byte in track, but found nothing."
-                      << std::endl;
-            return {};
-        } else if (character != 'T') {
-            std::cerr << " is not a MIDI file" << std::endl;
-            std::cerr << "Expecting 'T' at second byte in track but got '"
-                      << (char) character << "'" << std::endl;
-            return {};
+        ulong length = ((ulong) pos[4] << 24) | ((ulong) pos[5] << 16) | ((ulong) pos[6] << 8) | (ulong) pos[7];
+        pos += 8;
+        if (length < 4 || (ulong) (end - pos) < length) {
+            return false;
         }
-
-        character = input.get();
-        if (character == EOF) {
-            std::cerr << "unexpected end of file." << std::endl;
-            std::cerr << "Expecting 'r' at third byte in track, but found nothing."
-                      << std::endl;
-            return {};
-        } else if (character != 'r') {
-            std::cerr << "is not a MIDI file" << std::endl;
-            std::cerr << "Expecting 'r' at third byte in track but got '"
-                      << (char) character << "'" << std::endl;
-            return {};
+        const uchar* chunkEnd = pos + length;
+        // the shortest possible last event is a zero delta time and
+        // an end-of-track message: 00 FF 2F 00.
+        if (chunkEnd[-3] != 0xff || chunkEnd[-2] != 0x2f || chunkEnd[-1] != 0x00) {
+            return false;
         }
+        chunks.emplace_back(pos, chunkEnd);
+        pos = chunkEnd;
+    }
+    return true;
+}
 
-        character = input.get();
-        if (character == EOF) {
-            std::cerr << " unexpected end of file." << std::endl;
-            std::cerr << "Expecting 'k' at fourth byte in track, but found nothing."
-                      << std::endl;
-            return {};
-        } else if (character != 'k') {
-            std::cerr << "File is not a MIDI file" << std::endl;
-            std::cerr << "Expecting 'k' at fourth byte in track but got '"
-                      << (char) character << "'" << std::endl;
-            return {};
+// MidiFile::readTracksParallel -- Decode every track chunk on its own
+//    worker thread.  Returns false if the chunk directory is not
+//    consistent or if any track does not decode to exactly its declared
+//    length, in which case the serial reader has to be used instead.
+//    Errors in the data are not printed here, since the serial reader
+//    reports them again.
+bool readTracksParallel(const uchar* pos, const uchar* end, MidiData& data, PayloadArena* arena) {
+    int n = (int) data.getNumberOfTracks();
+    std::vector<TrackChunk> chunks;
+    if (!scanTrackChunks(pos, end, n, chunks)) {
+        return false;
+    }
+
+    std::atomic<bool> consistent{true};
+    parallelFor(n, [&](int i) {
+        ByteReader input(chunks[i].first, chunks[i].second);
+        MidiEventList& track = data.tracks()[i];
+        track.clear();
+        track.reserve((chunks[i].second - chunks[i].first) / 2);
+        if (!readTrackEvents(input, i, track, arena, true) || !input.atEnd() || track.empty() || !track.back().isEndOfTrack()) {
+            consistent = false;
         }
+    });
+    return consistent;
+}
 
-        // Now read track chunk size and throw it away because it is
-        // not really necessary since the track MUST end with an
-        // end of track meta event, and many MIDI files found in the wild
-        // do not correctly give the track size.
-        longdata = readLittleEndian4Bytes(input);
-
-        // set the size of the track allocation so that it might
-        // approximately fit the data.
-        data.tracks()[i].reserve((int) longdata / 2);
-        data.tracks()[i].clear();
-
-        // process the track
-        int absticks = 0;
-        // barline = 1;
-        while (!input.eof()) {
-            longdata = readVLValue(input);
-            //std::cout << "ticks = " << longdata << std::endl;
-            absticks += longdata;
-            xstatus = extractMidiData(input, bytes, runningCommand);
-            if (xstatus == 0) {
-                return {};
-            }
-            event.setContent(bytes);
-            //std::cout << "command = " << std::hex << (int)event.data[0] << std::dec << std::endl;
-            if (bytes[0] == 0xff && (bytes[1] == 1 ||
-                                     bytes[1] == 2 || bytes[1] == 3 || bytes[1] == 4)) {
-                // mididata.push_back('\0');
-                // std::cout << '\t';
-                // for (int m=0; m<event.data[2]; m++) {
-                //    std::cout << event.data[m+3];
-                // }
-                // std::cout.flush();
-            } else if (bytes[0] == 0xff && bytes[1] == 0x2f) {
-                // end of track message
-                // uncomment out the following three lines if you don't want
-                // to see the end of track message (which is always required,
-                // and added automatically when a MIDI is written.
-                event.tick = absticks;
-                event.track = i;
-                data.tracks()[i].push_back(event);
-                break;
-            }
+// MidiFile::read -- Parse a Standard MIDI File which is already in
+//      memory.  The buffer is read in place, without copying it.
+//      With options.parallelTracks, the tracks are decoded concurrently
+//      if the MTrk chunk lengths are consistent.
+MidiData read(std::span<const std::byte> buffer, const ReadOptions& options) {
+    if (buffer.empty() || buffer[0] != std::byte{'M'}) {
+        throw std::runtime_error("Bad MIDI data input");
+    }
 
-            if (bytes[0] != 0xff && bytes[0] != 0xf0) {
-                event.tick = absticks;
-                event.track = i;
-                data.tracks()[i].push_back(event);
-            } else {
-                event.tick = absticks;
-                event.track = i;
-                data.tracks()[i].push_back(event);
-            }
+    auto begin = reinterpret_cast<const uchar*>(buffer.data());
+    auto end = begin + buffer.size();
+    ByteReader input(begin, end);
+
+    MidiData data;
+    int n;
+    int tpq;
+    int smpteFrames;
+    int smpteSubframes;
+    if (!readHeader(input, n, tpq, &smpteFrames, &smpteSubframes)) {
+        return {};
+    }
+    if (smpteFrames > 0 && smpteSubframes > 0) {
+        data.setSmpteTimeBase(smpteFrames, smpteSubframes);
+    } else {
+        data.setTicksPerQuarterNote(tpq);
+    }
+
+    PayloadArena* arena = nullptr;
+    if (options.payloadArena) {
+        // the payloads cannot be larger than the file
+        data.setPayloadArena(std::make_shared<PayloadArena>(
+                std::min(buffer.size(), PayloadArena::defaultChunkSize)));
+        arena = data.getPayloadArena().get();
+    }
+
+    // now read individual tracks:
+    data.tracks().resize(n);
+    bool done = options.parallelTracks && n > 1 && readTracksParallel(input.position(), end, data, arena);
+    for (int i = 0; !done && i < n; i++) {
+        if (!readTrack(input, i, data.tracks()[i], arena)) {
+            return {};
         }
     }
 
@@ -655,170 +461,268 @@ MidiData read(std::istream& input) {
     return data;
 }
 
+// istream version of MidiFile::read().  The remaining stream content
+//    is read into memory in one go and parsed from there.
+MidiData read(std::istream& input, const ReadOptions& options) {
+    if (input.peek() != 'M') {
+        throw std::runtime_error("Bad MIDI data input");
+    }
+    std::vector<char> buffer{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+    return read(std::as_bytes(std::span(buffer)), options);
+}
+
 // MidiFile::read -- Parse a Standard MIDI File and store its contents
-//      in the object.
-MidiData read(const std::string& filename) {
-    std::ifstream input;
-    input.open(filename.c_str(), std::ios::binary | std::ios::in);
+//      in the object.  The file is memory-mapped and parsed in place.
+MidiData read(const std::string& filename, const ReadOptions& options) {
+    MappedFile file(filename);
+    return read(file.bytes(), options);
+}
 
-    if (!input.is_open()) {
-        throw std::runtime_error("file could not be opened");
+// MidiFile::vlvSize -- number of bytes of value written as a VLV.
+std::size_t vlvSize(ulong value) {
+    if (value < (1ul << 7)) {
+        return 1;
+    } else if (value < (1ul << 14)) {
+        return 2;
+    } else if (value < (1ul << 21)) {
+        return 3;
     }
-
-    return read(input);
+    return 4;
 }
 
-// MidiFile::writeVLValue -- write a number to the midifile
+// MidiFile::putVLValue -- write a number to the output buffer
 //    as a variable length value which segments a file into 7-bit
 //    values and adds a contination bit to each.  Maximum size of input
-//    aValue is 0x0FFFffff.
-void writeVLValue(long aValue, std::vector<uchar>& outdata) {
-    uchar bytes[4] = {0};
-
+//    aValue is 0x0FFFffff.  Returns the position after the value.
+uchar* putVLValue(long aValue, uchar* out) {
     if ((unsigned long) aValue >= (1 << 28)) {
         std::cerr << "Error: number too large to convert to VLV" << std::endl;
         aValue = 0x0FFFffff;
     }
+    auto value = (ulong) aValue;
+    std::size_t size = vlvSize(value);
+    for (std::size_t i = size - 1; i > 0; i--) {
+        *out++ = (uchar) (((value >> (7 * i)) & 0x7f) | 0x80);
+    }
+    *out++ = (uchar) (value & 0x7f);
+    return out;
+}
 
-    bytes[0] = (uchar)(((ulong) aValue >> 21) & 0x7f);// most significant 7 bits
-    bytes[1] = (uchar)(((ulong) aValue >> 14) & 0x7f);
-    bytes[2] = (uchar)(((ulong) aValue >> 7) & 0x7f);
-    bytes[3] = (uchar)(((ulong) aValue) & 0x7f);// least significant 7 bits
+// MidiFile::putBigEndianULong -- write the lower four bytes of value,
+//    largest byte first.
+uchar* putBigEndianULong(ulong value, uchar* out) {
+    *out++ = (uchar) ((value >> 24) & 0xff);
+    *out++ = (uchar) ((value >> 16) & 0xff);
+    *out++ = (uchar) ((value >> 8) & 0xff);
+    *out++ = (uchar) (value & 0xff);
+    return out;
+}
 
-    int start = 0;
-    while ((start < 4) && (bytes[start] == 0)) start++;
+uchar* putBigEndianUShort(ushort value, uchar* out) {
+    *out++ = (uchar) ((value >> 8) & 0xff);
+    *out++ = (uchar) (value & 0xff);
+    return out;
+}
 
-    for (int i = start; i < 3; i++) {
-        bytes[i] = bytes[i] | 0x80;
-        outdata.push_back(bytes[i]);
-    }
-    outdata.push_back(bytes[3]);
+// MidiFile::isWritten -- Empty events (probably delete messages) and
+//    end-of-track meta messages are not written; one end-of-track
+//    message is added automatically after all track data.
+bool isWritten(const MidiEvent& event) {
+    return !event.isEmpty() && !event.isEndOfTrack();
 }
 
-// ostream version of MidiFile::write().
-bool write(std::ostream& out, MidiData& data) {
-    int oldTimeState = data.getTickState();
-    if (oldTimeState == TIME_STATE_ABSOLUTE) {
-        data.makeDeltaTicks();
-    }
+bool isSysex(const MidiEvent& event) {
+    return event.getCommandByte() == 0xf0 || event.getCommandByte() == 0xf7;
+}
 
-    // write the header of the Standard MIDI File
-    char ch;
-    // 1. The characters "MThd"
-    ch = 'M';
-    out << ch;
-    ch = 'T';
-    out << ch;
-    ch = 'h';
-    out << ch;
-    ch = 'd';
-    out << ch;
+// SizeCounter -- byte sink for encodeEvents() which only counts.
+struct SizeCounter {
+    void put(uchar) {
+        size++;
+    }
 
-    // 2. write the size of the header (always a "6" stored in unsigned long
-    //    (4 bytes).
-    ulong longdata = 6;
-    writeBigEndianULong(out, longdata);
+    void putVLValue(long value) {
+        size += vlvSize((ulong) std::min<long>(value, 0x0FFFffff));
+    }
 
-    // 3. MIDI file format, type 0, 1, or 2
-    ushort shortdata;
-    shortdata = (data.getNumberOfTracks() == 1) ? 0 : 1;
-    writeBigEndianUShort(out, shortdata);
+    std::size_t size = 0;
+};
 
-    // 4. write out the number of tracks.
-    shortdata = data.getNumberOfTracks();
-    writeBigEndianUShort(out, shortdata);
+// BufferWriter -- byte sink for encodeEvents() which writes to memory.
+struct BufferWriter {
+    void put(uchar byte) {
+        *out++ = byte;
+    }
 
-    // 5. write out the number of ticks per quarternote. (avoiding SMTPE for now)
-    shortdata = data.getTicksPerQuarterNote();
-    writeBigEndianUShort(out, shortdata);
+    void putVLValue(long value) {
+        out = File::putVLValue(value, out);
+    }
 
-    // now write each track.
-    std::vector<uchar> trackdata;
-    uchar endoftrack[4] = {0, 0xff, 0x2f, 0x00};
-    int i, j, k;
-    int size;
-    for (i = 0; i < data.getNumberOfTracks(); i++) {
-        trackdata.reserve(123456);// make the track data larger than
-        // expected data input
-        trackdata.clear();
-        for (j = 0; j < (int) data.tracks()[i].size(); j++) {
-            if (data.tracks()[i][j].isEmpty()) {
-                // Don't write empty m_events (probably a delete message).
-                continue;
-            }
-            if (data.tracks()[i][j].isEndOfTrack()) {
-                // Suppress end-of-track meta messages (one will be added
-                // automatically after all track data has been written).
-                continue;
+    uchar* out;
+};
+
+// MidiFile::encodeEvents -- Write the events of a track to the sink.
+//    With absoluteTicks the delta times are computed on the fly from
+//    the previous written event, otherwise the ticks are written as
+//    they are.  The same code computes the size of a track and writes
+//    it, so both always agree.
+template<typename Sink>
+void encodeEvents(const MidiEventList& track, bool absoluteTicks, const WriteOptions& options, Sink& sink) {
+    // runningCommand == status byte of the last channel message, or 0
+    // after a meta or sysex message, which cancel running status.
+    uchar runningCommand = 0;
+    int previousTick = 0;
+    for (const auto& event : track) {
+        if (!isWritten(event)) {
+            continue;
+        }
+        int delta = event.tick;
+        if (absoluteTicks) {
+            delta = event.tick - previousTick;
+            previousTick = event.tick;
+            if (delta < 0) {
+                std::cerr << "Error: negative delta tick value: " << delta << std::endl
+                          << "Timestamps must be sorted first"
+                          << " (use MidiFile::sortTracks() before writing)." << std::endl;
             }
-            writeVLValue(data.tracks()[i][j].tick, trackdata);
-            if ((data.tracks()[i][j].getCommandByte() == 0xf0) ||
-                (data.tracks()[i][j].getCommandByte() == 0xf7)) {
-                // 0xf0 == Complete sysex message (0xf0 is part of the raw MIDI).
-                // 0xf7 == Raw byte message (0xf7 not part of the raw MIDI).
-                // Print the first byte of the message (0xf0 or 0xf7), then
-                // print a VLV length for the rest of the bytes in the message.
-                // In other words, when creating a 0xf0 or 0xf7 MIDI message,
-                // do not insert the VLV byte length yourself, as this code will
-                // do it for you automatically.
-                trackdata.push_back((data.tracks()[i])[j][0]);// 0xf0 or 0xf7;
-                writeVLValue(((int) (data.tracks()[i])[j].getSize()) - 1, trackdata);
-                for (k = 1; k < (int) (data.tracks()[i])[j].getSize(); k++) {
-                    trackdata.push_back((data.tracks()[i])[j][k]);
-                }
-            } else {
-                // non-sysex type of message, so just output the
-                // bytes of the message:
-                for (k = 0; k < (int) (data.tracks()[i])[j].getSize(); k++) {
-                    trackdata.push_back((data.tracks()[i])[j][k]);
-                }
+        }
+        sink.putVLValue(delta);
+        std::size_t size = event.getSize();
+        uchar status = event[0];
+        if (isSysex(event)) {
+            // 0xf0 == Complete sysex message (0xf0 is part of the raw MIDI).
+            // 0xf7 == Raw byte message (0xf7 not part of the raw MIDI).
+            // Print the first byte of the message (0xf0 or 0xf7), then
+            // print a VLV length for the rest of the bytes in the message.
+            // In other words, when creating a 0xf0 or 0xf7 MIDI message,
+            // do not insert the VLV byte length yourself, as this code will
+            // do it for you automatically.
+            sink.put(status);
+            sink.putVLValue((long) size - 1);
+            for (std::size_t k = 1; k < size; k++) {
+                sink.put(event[(int) k]);
             }
+            runningCommand = 0;
+            continue;
         }
-        size = (int) trackdata.size();
-        if ((size < 3) || !((trackdata[size - 3] == 0xff) && (trackdata[size - 2] == 0x2f))) {
-            trackdata.push_back(endoftrack[0]);
-            trackdata.push_back(endoftrack[1]);
-            trackdata.push_back(endoftrack[2]);
-            trackdata.push_back(endoftrack[3]);
+
+        // non-sysex type of message, so just output the
+        // bytes of the message:
+        bool noteOff = options.noteOffAsZeroVelocity && size == 3 && (status & 0xf0) == 0x80;
+        if (noteOff) {
+            status = 0x90 | (status & 0x0f);
         }
+        bool channelMessage = status >= 0x80 && status < 0xf0;
+        if (!(options.runningStatus && channelMessage && status == runningCommand)) {
+            sink.put(status);
+        }
+        runningCommand = channelMessage ? status : 0;
+        for (std::size_t k = 1; k < size; k++) {
+            sink.put(noteOff && k == 2 ? 0 : event[(int) k]);
+        }
+    }
+}
+
+// MidiFile::encodedTrackSize -- number of bytes of the MTrk chunk which
+//    encodeTrack() writes for the track, including the chunk header and
+//    an end-of-track message.
+std::size_t encodedTrackSize(const MidiEventList& track, bool absoluteTicks, const WriteOptions& options) {
+    SizeCounter counter;
+    encodeEvents(track, absoluteTicks, options, counter);
+    return 8 + counter.size + 4;
+}
+
+// MidiFile::encodeTrack -- Write the track as an MTrk chunk.  Returns
+//    the position after the chunk.
+uchar* encodeTrack(const MidiEventList& track, bool absoluteTicks, const WriteOptions& options, uchar* out) {
+    // first write the track ID marker "MTrk", the size of the
+    // MIDI data to follow is filled in at the end:
+    *out++ = 'M';
+    *out++ = 'T';
+    *out++ = 'r';
+    *out++ = 'k';
+    uchar* sizeField = out;
+    out += 4;
+    uchar* start = out;
+
+    BufferWriter writer{out};
+    encodeEvents(track, absoluteTicks, options, writer);
+    out = writer.out;
+
+    // end-of-track messages are never written by encodeEvents(), so
+    // always add one at the end of the track
+    *out++ = 0;
+    *out++ = 0xff;
+    *out++ = 0x2f;
+    *out++ = 0x00;
+    putBigEndianULong((ulong) (out - start), sizeField);
+    return out;
+}
+
+// MidiFile::writeToBuffer -- Serialize the MIDI data as a Standard MIDI
+//    File into one buffer.  The exact size is computed first, so the
+//    buffer is allocated only once.  The data is only read, so several
+//    threads may write the same MidiData at the same time.
+std::vector<uchar> writeToBuffer(const MidiData& data, const WriteOptions& options) {
+    bool absoluteTicks = data.isAbsoluteTicks();
+
+    std::size_t total = 14;
+    for (const auto& track : data.tracks()) {
+        total += encodedTrackSize(track, absoluteTicks, options);
+    }
+    std::vector<uchar> buffer(total);
 
-        // now ready to write to MIDI file.
+    // write the header of the Standard MIDI File
+    uchar* out = buffer.data();
+    // 1. The characters "MThd"
+    *out++ = 'M';
+    *out++ = 'T';
+    *out++ = 'h';
+    *out++ = 'd';
+
+    // 2. write the size of the header (always a "6" stored in unsigned long
+    //    (4 bytes).
+    out = putBigEndianULong(6, out);
 
-        // first write the track ID marker "MTrk":
-        ch = 'M';
-        out << ch;
-        ch = 'T';
-        out << ch;
-        ch = 'r';
-        out << ch;
-        ch = 'k';
-        out << ch;
+    // 3. MIDI file format, type 0, 1, or 2
+    out = putBigEndianUShort((data.getNumberOfTracks() == 1) ? 0 : 1, out);
 
-        // A. write the size of the MIDI data to follow:
-        longdata = (int) trackdata.size();
-        writeBigEndianULong(out, longdata);
+    // 4. write out the number of tracks.
+    out = putBigEndianUShort(data.getNumberOfTracks(), out);
 
-        // B. write the actual data
-        out.write((char*) trackdata.data(), trackdata.size());
+    // 5. write out the number of ticks per quarternote, or the SMPTE
+    //    frame rate (as a negative 2's complement value) and subframes.
+    if (data.isSmpteTimeBase()) {
+        out = putBigEndianUShort(((256 - data.getSmpteFramesPerSecond()) << 8) | data.getSmpteSubframes(), out);
+    } else {
+        out = putBigEndianUShort(data.getTicksPerQuarterNote(), out);
     }
 
-    if (oldTimeState == TIME_STATE_ABSOLUTE) {
-        data.makeAbsoluteTicks();
+    // now write each track.
+    for (const auto& track : data.tracks()) {
+        out = encodeTrack(track, absoluteTicks, options, out);
     }
+    assert(out == buffer.data() + total);
+    return buffer;
+}
 
-    return true;
+// ostream version of MidiFile::write().
+bool write(std::ostream& out, const MidiData& data, const WriteOptions& options) {
+    std::vector<uchar> buffer = writeToBuffer(data, options);
+    out.write((const char*) buffer.data(), (std::streamsize) buffer.size());
+    return !out.fail();
 }
 
 // MidiFile::write -- write a standard MIDI file to a file or an output
 //    stream.
-bool write(const std::string& filename, MidiData& data) {
-    std::fstream output(filename.c_str(), std::ios::binary | std::ios::out);
+bool write(const std::string& filename, const MidiData& data, const WriteOptions& options) {
+    std::ofstream output(filename, std::ios::binary | std::ios::out);
 
     if (!output.is_open()) {
         std::cerr << "Error: could not write: " << filename << std::endl;
         return false;
     }
-    bool status = write(output, data);
+    bool status = write(output, data, options);
     output.close();
     return status;
 }
@@ -18,7 +18,7 @@ MidiMessage::MidiMessage(int command, int p1, int p2)
     : content({static_cast<uchar>(command), static_cast<uchar>(p1), static_cast<uchar>(p2)}) {}
 
 MidiMessage::MidiMessage(Content content)
-    : content(std::move(content)) {
+    : content(content) {
 }
 
 // MidiMessage::getSize -- Return the size of the MIDI message bytes.
@@ -68,7 +68,7 @@ int MidiMessage::resizeToCommand() {
             return getSize();
     }
     if (bytecount + 1 < osize) {
-        content = Content(bytecount + 1, 0);
+        content.assign(bytecount + 1, 0);
     }
 
     return getSize();
@@ -131,6 +131,25 @@ double MidiMessage::getTempoSPT(int tpq) const {
     }
 }
 
+// MidiMessage::getTimeSignatureNumerator -- Returns the number of beats
+//      per bar of a time signature meta message, or -1.
+int MidiMessage::getTimeSignatureNumerator() const {
+    if (!isTimeSignature()) {
+        return -1;
+    }
+    return content[3];
+}
+
+// MidiMessage::getTimeSignatureDenominator -- The MIDI file stores the
+//      denominator as a power of two.
+int MidiMessage::getTimeSignatureDenominator() const {
+    if (!isTimeSignature()) {
+        return -1;
+    }
+    int power = content[4];
+    return power < 16 ? 1 << power : -1;
+}
+
 // MidiMessage::isMeta -- Returns true if message is a Meta message
 //      (when the command byte is 0xff).
 bool MidiMessage::isMeta() const {
@@ -749,6 +768,16 @@ void MidiMessage::setContent(Content const& otherContent) {
     content = otherContent;
 }
 
+void MidiMessage::setContent(const uchar* bytes, std::size_t count) {
+    content.assign(bytes, count);
+}
+
+// MidiMessage::borrowContent -- Refer to bytes which are owned elsewhere
+//   and outlive the message, without copying them.
+void MidiMessage::borrowContent(const uchar* bytes, std::size_t count) {
+    content.borrow(bytes, count);
+}
+
 // MidiMessage::setSpelling -- Encode a MidiPlus accidental state for a note.
 //    For example, if a note's key number is 60, the enharmonic pitch name
 //    could be any of these possibilities:
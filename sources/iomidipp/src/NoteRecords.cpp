@@ -0,0 +1,97 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <algorithm>
+
+#include <iomidipp/NoteRecords.h>
+
+namespace imp {
+
+namespace {
+
+// appendNotes -- Pair the note-ons and note-offs of list like
+//    linkNotePairs() (the first note-off ends the last note-on of the same
+//    channel and key) and append the notes to notes in onset order.  The
+//    open notes of each channel and key form a stack of record indices
+//    threaded through workspace.noteNext.
+void appendNotes(const MidiEventList& list, bool deltaTicks, std::vector<NoteRecord>& notes,
+                 LinkWorkspace& workspace) {
+    workspace.reset(list.size());
+    auto& noteHeads = workspace.noteHeads;
+    auto& noteNext = workspace.noteNext;
+    const std::size_t first = notes.size();
+    int open = 0;
+    int tick = 0;
+    for (const auto& event : list) {
+        tick = deltaTicks ? tick + event.tick : event.tick;
+        if (event.isNoteOn()) {
+            int key = event.getKeyNumber() & 0x7f;
+            int& head = noteHeads[event.getChannel() * 128 + key];
+            int record = (int) (notes.size() - first);
+            noteNext[record] = head;
+            head = record;
+            notes.push_back({tick, tick, event.seconds, event.seconds, event.track, (uchar) key,
+                             (uchar) event.getP2(), (uchar) event.getChannel()});
+            open++;
+        } else if (event.isNoteOff()) {
+            int& head = noteHeads[event.getChannel() * 128 + (event.getKeyNumber() & 0x7f)];
+            if (head >= 0) {
+                NoteRecord& note = notes[first + head];
+                head = noteNext[head];
+                note.offsetTick = tick;
+                note.offsetSeconds = event.seconds;
+                open--;
+            }
+        }
+    }
+    if (open == 0) {
+        return;
+    }
+    // drop the notes which are still open at the end of the list
+    std::vector<bool> unterminated(notes.size() - first);
+    for (int head : noteHeads) {
+        for (int record = head; record >= 0; record = noteNext[record]) {
+            unterminated[record] = true;
+        }
+    }
+    std::size_t kept = first;
+    for (std::size_t i = first; i < notes.size(); i++) {
+        if (!unterminated[i - first]) {
+            notes[kept++] = notes[i];
+        }
+    }
+    notes.resize(kept);
+}
+
+}// namespace
+
+// extractNotes -- Returns the notes of list as NoteRecords.
+std::vector<NoteRecord> extractNotes(const MidiEventList& list) {
+    std::vector<NoteRecord> notes;
+    LinkWorkspace workspace;
+    extractNotes(list, notes, workspace);
+    return notes;
+}
+
+void extractNotes(const MidiEventList& list, std::vector<NoteRecord>& notes, LinkWorkspace& workspace) {
+    appendNotes(list, false, notes, workspace);
+}
+
+// extractNotes -- Returns the notes of all tracks of data, sorted by
+//    onset tick.  The time map is built first if it is out of date, so
+//    the seconds are valid.
+std::vector<NoteRecord> extractNotes(MidiData& data) {
+    data.getTempoMap();
+    std::vector<NoteRecord> notes;
+    LinkWorkspace workspace;
+    for (const auto& track : data.tracks()) {
+        appendNotes(track, data.isDeltaTicks(), notes, workspace);
+    }
+    std::stable_sort(notes.begin(), notes.end(), [](const NoteRecord& a, const NoteRecord& b) {
+        return a.onsetTick < b.onsetTick;
+    });
+    return notes;
+}
+
+}// namespace imp
@@ -0,0 +1,76 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <system_error>
+#include <utility>
+
+#include "Parallel.h"
+
+namespace imp {
+
+// ThreadPool::ThreadPool -- Start the worker threads.  If the system
+//    cannot start all of them, the pool works with fewer.
+ThreadPool::ThreadPool(unsigned threads) {
+    m_threads.reserve(threads);
+    try {
+        for (unsigned i = 0; i < threads; i++) {
+            m_threads.emplace_back([this]() { run(); });
+        }
+    } catch (const std::system_error&) {
+        // no more threads available
+    }
+}
+
+// ThreadPool::~ThreadPool -- Let the threads finish the submitted tasks
+//    and join them.
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wakeup.notify_all();
+    for (auto& thread : m_threads) {
+        thread.join();
+    }
+}
+
+// ThreadPool::instance -- The pool is started on first use.
+ThreadPool& ThreadPool::instance() {
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+// ThreadPool::submit -- Queue a task for the next free thread.  Without
+//    threads, the task is run right away.
+void ThreadPool::submit(std::function<void()> task) {
+    if (m_threads.empty()) {
+        task();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_wakeup.notify_one();
+}
+
+// ThreadPool::run -- Loop of a worker thread.  Tasks do not throw: the
+//    tasks of parallelFor() catch the exceptions of their work items.
+void ThreadPool::run() {
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_wakeup.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+            if (m_tasks.empty()) {
+                return;
+            }
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+        }
+        task();
+    }
+}
+
+}// namespace imp
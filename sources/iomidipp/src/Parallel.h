@@ -0,0 +1,125 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace imp {
+
+// ThreadPool -- Worker threads which are started once and run the tasks
+//    given to submit() in order.  The threads are stopped when the pool
+//    is destroyed, after the tasks already submitted.
+class ThreadPool {
+public:
+    explicit ThreadPool(unsigned threads);
+
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // the pool shared by the whole library, with one thread less than
+    // std::thread::hardware_concurrency() since callers take part in
+    // the work:
+    static ThreadPool& instance();
+
+    void submit(std::function<void()> task);
+
+    [[nodiscard]] unsigned size() const {
+        return (unsigned) m_threads.size();
+    }
+
+private:
+    void run();
+
+    std::mutex m_mutex;
+    std::condition_variable m_wakeup;
+    std::deque<std::function<void()>> m_tasks;
+    bool m_stopping = false;
+    std::vector<std::thread> m_threads;
+};
+
+// parallelFor -- Call fn(i) for every i in [0, count) on the threads of
+//    pool.  Work items are handed out one at a time, so uneven items
+//    (e.g. tracks of very different lengths) balance out.  The calling
+//    thread takes part in the work and can finish all items on its own,
+//    so parallelFor() may be called from within fn (or while all threads
+//    of the pool are busy) without waiting for a free thread.  If fn
+//    throws, no further items are started and the first exception is
+//    rethrown on the calling thread once the running items are done.
+template<typename Function>
+void parallelFor(ThreadPool& pool, int count, Function&& fn) {
+    unsigned workers = std::min<unsigned>(pool.size() + 1, count > 0 ? count : 0);
+    if (workers <= 1) {
+        for (int i = 0; i < count; i++) {
+            fn(i);
+        }
+        return;
+    }
+
+    // shared with the pool tasks, which may start after all items are
+    // done and this function has returned; they then find no item left
+    // and do not touch fn.
+    struct Job {
+        std::atomic<int> next{0};
+        std::atomic<int> remaining{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable finished;
+    };
+    auto job = std::make_shared<Job>();
+    job->remaining = count;
+    auto work = [job, count, &fn]() {
+        for (int i = job->next++; i < count; i = job->next++) {
+            if (!job->failed) {
+                try {
+                    fn(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(job->mutex);
+                    if (!job->error) {
+                        job->error = std::current_exception();
+                    }
+                    job->failed = true;
+                }
+            }
+            if (--job->remaining == 0) {
+                std::lock_guard<std::mutex> lock(job->mutex);
+                job->finished.notify_all();
+            }
+        }
+    };
+    try {
+        for (unsigned w = 1; w < workers; w++) {
+            pool.submit(work);
+        }
+    } catch (...) {
+        // the items not taken by the pool are done by this thread
+    }
+    work();
+    std::unique_lock<std::mutex> lock(job->mutex);
+    job->finished.wait(lock, [&job]() { return job->remaining == 0; });
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+// parallelFor -- As above, on the threads of ThreadPool::instance().
+template<typename Function>
+void parallelFor(int count, Function&& fn) {
+    parallelFor(ThreadPool::instance(), count, std::forward<Function>(fn));
+}
+
+}// namespace imp
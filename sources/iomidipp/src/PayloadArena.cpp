@@ -0,0 +1,54 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <algorithm>
+#include <cstring>
+
+#include <iomidipp/PayloadArena.h>
+
+namespace imp {
+
+PayloadArena::PayloadArena(std::size_t chunkSize)
+    : m_chunkSize(std::max<std::size_t>(chunkSize, 256)) {}
+
+// PayloadArena::allocate -- Bump-allocate count bytes.  The first chunk
+//    is only allocated on the first request.  Requests larger than half
+//    a chunk get a chunk of their own so that the rest of the current
+//    chunk is not wasted.
+uchar* PayloadArena::allocate(std::size_t count) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_used += count;
+    if (count > m_available) {
+        if (count > m_chunkSize / 2) {
+            m_chunks.emplace_back(new uchar[count]);
+            return m_chunks.back().get();
+        }
+        if (!m_chunks.empty()) {
+            m_chunkSize *= 2;
+        }
+        m_chunks.emplace_back(new uchar[m_chunkSize]);
+        m_next = m_chunks.back().get();
+        m_available = m_chunkSize;
+    }
+    uchar* result = m_next;
+    m_next += count;
+    m_available -= count;
+    return result;
+}
+
+// PayloadArena::store -- Copy bytes into the arena.
+const uchar* PayloadArena::store(const uchar* bytes, std::size_t count) {
+    uchar* target = allocate(count);
+    if (count > 0) {
+        std::memcpy(target, bytes, count);
+    }
+    return target;
+}
+
+std::size_t PayloadArena::getUsedBytes() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_used;
+}
+
+}// namespace imp
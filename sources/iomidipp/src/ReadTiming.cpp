@@ -0,0 +1,174 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include <iomidipp/MappedFile.h>
+#include <iomidipp/MidiFile.h>
+
+#include "SmfParsing.h"
+
+namespace imp::File {
+
+namespace {
+
+// TimingEvent -- a tempo or time signature message; the bytes point to
+//    the meta data after the length.
+struct TimingEvent {
+    int tick;
+    uchar type;
+    const uchar* bytes;
+};
+
+// channelDataBytes -- number of data bytes after a channel status byte.
+int channelDataBytes(uchar status) {
+    switch (status & 0xf0) {
+        case 0xC0:// patch change
+        case 0xD0:// channel pressure
+            return 1;
+        default:
+            return 2;
+    }
+}
+
+// scanTrack -- Walk the events of one track from pos up to its end-of-
+//    track message, appending tempo and time signature messages to
+//    events.  Returns the position after the track, or nullptr if the
+//    track is malformed.  The last tick of the track is stored in
+//    lastTick.
+const uchar* scanTrack(const uchar* pos, const uchar* end, std::vector<TimingEvent>& events, int& lastTick) {
+    int tick = 0;
+    uchar runningCommand = 0;
+    while (pos < end) {
+        ulong delta;
+        std::size_t length = decodeVlv(pos, end, delta);
+        if (length == 0) {
+            return nullptr;
+        }
+        pos += length;
+        tick += (int) delta;
+        if (pos >= end) {
+            return nullptr;
+        }
+        uchar byte = *pos;
+        if (byte < 0xf0) {
+            // with running status the byte is the first data byte
+            if (byte >= 0x80) {
+                runningCommand = byte;
+                pos++;
+            } else if (runningCommand == 0 || runningCommand >= 0xf0) {
+                return nullptr;
+            }
+            int dataBytes = channelDataBytes(runningCommand);
+            if (end - pos < dataBytes) {
+                return nullptr;
+            }
+            pos += dataBytes;
+        } else if (byte == 0xff) {
+            runningCommand = byte;
+            if (end - pos < 3) {
+                return nullptr;
+            }
+            uchar type = pos[1];
+            ulong size;
+            length = decodeVlv(pos + 2, end, size);
+            if (length == 0 || (ulong) (end - pos - 2 - length) < size) {
+                return nullptr;
+            }
+            const uchar* data = pos + 2 + length;
+            pos = data + size;
+            if ((type == 0x51 && size == 3) || (type == 0x58 && size == 4)) {
+                events.push_back({tick, type, data});
+            } else if (type == 0x2f) {
+                lastTick = tick;
+                return pos;
+            }
+        } else if (byte == 0xf0 || byte == 0xf7) {
+            runningCommand = byte;
+            ulong size;
+            length = decodeVlv(pos + 1, end, size);
+            if (length == 0 || (ulong) (end - pos - 1 - length) < size) {
+                return nullptr;
+            }
+            pos += 1 + length + size;
+        } else {
+            // other "F" commands have no payload to skip
+            runningCommand = byte;
+            pos++;
+        }
+        lastTick = tick;
+    }
+    return pos;
+}
+
+}// namespace
+
+// MidiFile::readTiming -- The tempo and meter maps are built from the
+//    collected messages in the same order as MidiData::getTempoMap()
+//    and getMeterMap() would apply them: by tick, then track, then file
+//    order.  A malformed track stops the scan and sets timing.failed;
+//    the messages found up to the error are still used.
+Timing readTiming(std::span<const std::byte> buffer) {
+    if (buffer.empty() || buffer[0] != std::byte{'M'}) {
+        throw std::runtime_error("Bad MIDI data input");
+    }
+    auto begin = reinterpret_cast<const uchar*>(buffer.data());
+    auto end = begin + buffer.size();
+    ByteReader input(begin, end);
+
+    Timing timing;
+    int n;
+    if (!readHeader(input, n, timing.ticksPerQuarterNote, &timing.smpteFramesPerSecond, &timing.smpteSubframes)) {
+        throw std::runtime_error("Bad MIDI data input");
+    }
+    if (timing.smpteSubframes == 0) {
+        timing.smpteFramesPerSecond = 0;
+    }
+
+    // the chunk length is ignored for the same reason as in read()
+    std::vector<TimingEvent> events;
+    for (int i = 0; i < n && !timing.failed; i++) {
+        ulong length;
+        if (!readChunkId(input, "MTrk") || !input.readBigEndian4Bytes(length)) {
+            timing.failed = true;
+            break;
+        }
+        int lastTick = 0;
+        const uchar* trackEnd = scanTrack(input.position(), end, events, lastTick);
+        if (trackEnd == nullptr) {
+            timing.failed = true;
+        } else {
+            input.skipTo(trackEnd);
+        }
+        timing.durationInTicks = std::max(timing.durationInTicks, lastTick);
+    }
+    std::stable_sort(events.begin(), events.end(),
+                     [](const TimingEvent& a, const TimingEvent& b) { return a.tick < b.tick; });
+
+    auto meterMap = std::make_shared<MeterMap>(timing.ticksPerQuarterNote);
+    auto tempoMap = timing.smpteFramesPerSecond > 0
+                            ? std::make_shared<TempoMap>(TempoMap::smpte(timing.smpteFramesPerSecond, timing.smpteSubframes))
+                            : std::make_shared<TempoMap>(timing.ticksPerQuarterNote);
+    for (const auto& event : events) {
+        if (event.type == 0x58) {
+            int power = event.bytes[1];
+            meterMap->setTimeSignature(event.tick, event.bytes[0], power < 16 ? 1 << power : -1);
+        } else if (timing.smpteFramesPerSecond == 0) {
+            tempoMap->setTempo(event.tick, (event.bytes[0] << 16) + (event.bytes[1] << 8) + event.bytes[2]);
+        }
+    }
+    timing.durationInSeconds = tempoMap->ticksToSeconds(timing.durationInTicks);
+    timing.tempoMap = std::move(tempoMap);
+    timing.meterMap = std::move(meterMap);
+    return timing;
+}
+
+Timing readTiming(const std::string& filename) {
+    MappedFile file(filename);
+    return readTiming(file.bytes());
+}
+
+}// namespace imp::File
@@ -0,0 +1,143 @@
+/**
+ * @copyright 1999-2020, Craig Stuart Sapp under BSD-2 license
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+#include <iomidipp/Utils.h>
+#include <iomidipp/Vlv.h>
+
+// Internal helpers shared by the Standard MIDI File readers.
+
+namespace imp::File {
+
+// ByteReader -- Bounds-checked cursor over an in-memory Standard MIDI
+//    File.  All reads are checked against the end of the buffer, so
+//    that a truncated file is reported instead of being read past.
+//    With quiet, failed reads are not printed.
+class ByteReader {
+public:
+    ByteReader(const uchar* begin, const uchar* end, bool quiet = false)
+        : m_pos(begin)
+        , m_end(end)
+        , m_quiet(quiet) {}
+
+    [[nodiscard]] bool atEnd() const {
+        return m_pos >= m_end;
+    }
+
+    [[nodiscard]] std::size_t remaining() const {
+        return static_cast<std::size_t>(m_end - m_pos);
+    }
+
+    [[nodiscard]] const uchar* position() const {
+        return m_pos;
+    }
+
+    [[nodiscard]] bool isQuiet() const {
+        return m_quiet;
+    }
+
+    // ByteReader::readByte -- Read one byte.  Returns false (and prints
+    //     an error) if the end of the buffer has been reached.
+    bool readByte(uchar& value) {
+        if (m_pos >= m_end) {
+            if (!m_quiet) {
+                std::cerr << "Error: unexpected end of file." << std::endl;
+            }
+            return false;
+        }
+        value = *m_pos++;
+        return true;
+    }
+
+    // ByteReader::readBytes -- Return a pointer to the next count bytes
+    //     in the buffer and advance past them, without copying.
+    bool readBytes(const uchar*& data, std::size_t count) {
+        if (remaining() < count) {
+            if (!m_quiet) {
+                std::cerr << "Error: unexpected end of file." << std::endl;
+            }
+            return false;
+        }
+        data = m_pos;
+        m_pos += count;
+        return true;
+    }
+
+    // ByteReader::skipTo -- Continue reading at pos, which has to lie
+    //     between the current position and the end of the buffer.
+    void skipTo(const uchar* pos) {
+        m_pos = pos;
+    }
+
+    // ByteReader::readBigEndian4Bytes -- Read four bytes which are in
+    //     big-endian order (largest byte is first).
+    bool readBigEndian4Bytes(ulong& value) {
+        const uchar* b;
+        if (!readBytes(b, 4)) {
+            return false;
+        }
+        value = ((ulong) b[0] << 24) | ((ulong) b[1] << 16) | ((ulong) b[2] << 8) | (ulong) b[3];
+        return true;
+    }
+
+    // ByteReader::readBigEndian2Bytes -- Read two bytes which are in
+    //     big-endian order (largest byte is first).
+    bool readBigEndian2Bytes(ushort& value) {
+        const uchar* b;
+        if (!readBytes(b, 2)) {
+            return false;
+        }
+        value = (ushort) ((b[0] << 8) | b[1]);
+        return true;
+    }
+
+private:
+    const uchar* m_pos;
+    const uchar* m_end;
+    bool m_quiet;
+};
+
+// TrackChunk == first and one-past-last byte of the event data of an
+// MTrk chunk.
+using TrackChunk = std::pair<const uchar*, const uchar*>;
+
+// readVLValue -- Read a variable-length value of at most four bytes
+//    (up to 0x0fffffff); longer values are not allowed in Standard MIDI
+//    Files.  Inline, since it runs once per event.
+inline bool readVLValue(ByteReader& input, ulong& value) {
+    const uchar* pos = input.position();
+    std::size_t length = decodeVlv(pos, pos + input.remaining(), value);
+    if (length == 0) {
+        if (input.isQuiet()) {
+            // nothing to report
+        } else if (input.remaining() < maxVlvBytes) {
+            std::cerr << "Error: unexpected end of file." << std::endl;
+        } else {
+            std::cerr << "Error: VLV number is too large" << std::endl;
+        }
+        return false;
+    }
+    input.skipTo(pos + length);
+    return true;
+}
+
+bool readChunkId(ByteReader& input, const char* expected);
+
+// for an SMPTE division, ticksPerQuarterNote is that of
+// TempoMap::smpte(), and smpteFramesPerSecond and smpteSubframes are the
+// frame rate and the subframes per frame (0 otherwise).
+bool readHeader(ByteReader& input, int& trackCount, int& ticksPerQuarterNote,
+                int* smpteFramesPerSecond = nullptr, int* smpteSubframes = nullptr);
+
+bool scanTrackChunks(const uchar* pos, const uchar* end, int trackCount,
+                     std::vector<TrackChunk>& chunks);
+
+}// namespace imp::File
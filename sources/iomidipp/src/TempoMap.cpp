@@ -0,0 +1,236 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <iomidipp/TempoMap.h>
+
+namespace imp {
+
+namespace {
+
+// floor(value * numerator / denominator) without overflow, as long as
+// numerator * denominator fits into 63 bits.
+std::int64_t scaleDown(std::int64_t value, std::int64_t numerator, std::int64_t denominator) {
+    std::int64_t quotient = value / denominator;
+    std::int64_t remainder = value % denominator;
+    if (remainder < 0) {
+        quotient--;
+        remainder += denominator;
+    }
+    return quotient * numerator + remainder * numerator / denominator;
+}
+
+// requireOutputSize -- the batch conversions write one output value per
+// input value.
+void requireOutputSize(std::size_t inputSize, std::size_t outputSize, const char* function) {
+    if (outputSize < inputSize) {
+        throw std::invalid_argument(std::string(function) + ": output is smaller than the input");
+    }
+}
+
+// forEachTickRun -- call convert(segment, begin, end) for each run of
+//    ticks[begin..end) inside the same segment.  For sorted input the end
+//    of each run is found by binary search.
+template <typename Convert>
+void forEachTickRun(const TempoMap& map, std::span<const int> ticks, Convert convert) {
+    std::size_t count = ticks.size();
+    bool sorted = std::is_sorted(ticks.begin(), ticks.end());
+    const auto& segments = map.getSegments();
+    std::size_t i = 0;
+    while (i < count) {
+        const TempoMap::Segment& segment = map.getSegmentAtTick(ticks[i]);
+        int limit = &segment == &segments.back() ? std::numeric_limits<int>::max() : (&segment + 1)->tick;
+        std::size_t end = i + 1;
+        if (sorted) {
+            end = std::lower_bound(ticks.begin() + i, ticks.end(), limit) - ticks.begin();
+        } else {
+            while (end < count && ticks[end] >= segment.tick && ticks[end] < limit) {
+                end++;
+            }
+        }
+        convert(segment, i, end);
+        i = end;
+    }
+}
+
+}// namespace
+
+TempoMap::TempoMap(int ticksPerQuarterNote)
+    : m_ticksPerQuarterNote(ticksPerQuarterNote) {
+    clear();
+}
+
+TempoMap::TempoMap(int ticksPerQuarterNote, const MidiEventList& events)
+    : TempoMap(ticksPerQuarterNote) {
+    for (const auto& event : events) {
+        if (event.isTempo()) {
+            setTempo(event.tick, event.getTempoMicroseconds());
+        }
+    }
+}
+
+// TempoMap::smpte -- A quarter note is one second of framesPerSecond *
+//    subframes ticks, or 1.001 seconds of 30 * subframes ticks for the
+//    29.97 drop-frame rate, so the time stays exact.
+TempoMap TempoMap::smpte(int framesPerSecond, int subframes) {
+    TempoMap map(smpteTicksPerQuarterNote(framesPerSecond, subframes));
+    map.setTempo(0, framesPerSecond == 29 ? 1001000 : 1000000);
+    return map;
+}
+
+int TempoMap::smpteTicksPerQuarterNote(int framesPerSecond, int subframes) {
+    return (framesPerSecond == 29 ? 30 : framesPerSecond) * subframes;
+}
+
+// TempoMap::clear -- back to a constant tempo of 120 beats per minute.
+void TempoMap::clear() {
+    m_segments.clear();
+    m_segments.push_back({0, 0.0, defaultTempoMicroseconds / 1000000.0 / m_ticksPerQuarterNote, defaultTempoMicroseconds, 0});
+}
+
+// TempoMap::eraseFrom -- The tempo before tick and the start times of
+//    the remaining segments are not affected.
+void TempoMap::eraseFrom(int tick) {
+    if (tick <= 0) {
+        clear();
+        return;
+    }
+    auto it = std::lower_bound(m_segments.begin(), m_segments.end(), tick,
+                               [](const Segment& s, int t) { return s.tick < t; });
+    m_segments.erase(it, m_segments.end());
+}
+
+// TempoMap::setTempo -- Tempo changes are usually added in tick order,
+//    which appends a segment in constant time.  Inserting earlier
+//    changes the start times of all later segments.
+void TempoMap::setTempo(int tick, int microsecondsPerQuarter) {
+    tick = std::max(tick, 0);
+    Segment segment{tick, 0.0, (double) microsecondsPerQuarter / 1000000.0 / m_ticksPerQuarterNote, microsecondsPerQuarter, 0};
+    auto it = std::lower_bound(m_segments.begin(), m_segments.end(), tick,
+                               [](const Segment& s, int t) { return s.tick < t; });
+    if (it != m_segments.end() && it->tick == tick) {
+        *it = segment;
+    } else {
+        it = m_segments.insert(it, segment);
+    }
+    updateSeconds(it - m_segments.begin());
+}
+
+// TempoMap::updateSeconds -- The start times are derived from the exact
+//    time units, so they do not accumulate rounding errors over many
+//    tempo changes.
+void TempoMap::updateSeconds(std::size_t index) {
+    const double unitsPerSecond = 1000000.0 * m_ticksPerQuarterNote;
+    for (std::size_t i = std::max<std::size_t>(index, 1); i < m_segments.size(); i++) {
+        m_segments[i].timeUnits = getTimeUnits(m_segments[i - 1], m_segments[i].tick);
+        m_segments[i].seconds = (double) m_segments[i].timeUnits / unitsPerSecond;
+    }
+}
+
+const TempoMap::Segment& TempoMap::getSegmentAtTick(double tick) const {
+    auto it = std::upper_bound(m_segments.begin() + 1, m_segments.end(), tick,
+                               [](double t, const Segment& s) { return t < s.tick; });
+    return *(it - 1);
+}
+
+const TempoMap::Segment& TempoMap::getSegmentAtSeconds(double seconds) const {
+    auto it = std::upper_bound(m_segments.begin() + 1, m_segments.end(), seconds,
+                               [](double t, const Segment& s) { return t < s.seconds; });
+    return *(it - 1);
+}
+
+// TempoMap::ticksToSeconds -- time in seconds at the given tick.
+double TempoMap::ticksToSeconds(double tick) const {
+    const Segment& segment = getSegmentAtTick(tick);
+    return segment.seconds + (tick - segment.tick) * segment.secondsPerTick;
+}
+
+// TempoMap::secondsToTicks -- (fractional) tick at the given time in
+//    seconds.
+double TempoMap::secondsToTicks(double seconds) const {
+    const Segment& segment = getSegmentAtSeconds(seconds);
+    return segment.tick + (seconds - segment.seconds) / segment.secondsPerTick;
+}
+
+// TempoMap::ticksToSeconds -- The loop over a run has no branches and
+//    no dependencies between iterations, so the compiler can turn it
+//    into SIMD code for whatever instruction set it targets.
+void TempoMap::ticksToSeconds(std::span<const int> ticks, std::span<double> seconds) const {
+    requireOutputSize(ticks.size(), seconds.size(), "TempoMap::ticksToSeconds");
+    forEachTickRun(*this, ticks, [&](const Segment& segment, std::size_t begin, std::size_t end) {
+        // same arithmetic as the single-value conversion
+        const double start = segment.tick;
+        const double base = segment.seconds;
+        const double slope = segment.secondsPerTick;
+        const int* in = ticks.data();
+        double* out = seconds.data();
+        for (std::size_t j = begin; j < end; j++) {
+            out[j] = base + (in[j] - start) * slope;
+        }
+    });
+}
+
+void TempoMap::secondsToTicks(std::span<const double> seconds, std::span<double> ticks) const {
+    requireOutputSize(seconds.size(), ticks.size(), "TempoMap::secondsToTicks");
+    std::size_t count = seconds.size();
+    bool sorted = std::is_sorted(seconds.begin(), seconds.end());
+    std::size_t i = 0;
+    while (i < count) {
+        const Segment& segment = getSegmentAtSeconds(seconds[i]);
+        double limit = &segment == &m_segments.back() ? std::numeric_limits<double>::infinity() : (&segment + 1)->seconds;
+        std::size_t end = i + 1;
+        if (sorted) {
+            end = std::lower_bound(seconds.begin() + i, seconds.end(), limit) - seconds.begin();
+        } else {
+            while (end < count && seconds[end] >= segment.seconds && seconds[end] < limit) {
+                end++;
+            }
+        }
+        const double start = segment.seconds;
+        const double base = segment.tick;
+        const double slope = segment.secondsPerTick;
+        const double* in = seconds.data();
+        double* out = ticks.data();
+        for (std::size_t j = i; j < end; j++) {
+            out[j] = base + (in[j] - start) / slope;
+        }
+        i = end;
+    }
+}
+
+// TempoMap::ticksToNanoseconds -- time units / ticks per quarter are
+//    microseconds.
+std::int64_t TempoMap::ticksToNanoseconds(int tick) const {
+    return scaleDown(getTimeUnits(getSegmentAtTick(tick), tick), 1000, m_ticksPerQuarterNote);
+}
+
+std::int64_t TempoMap::ticksToSamples(int tick, int sampleRate) const {
+    return scaleDown(getTimeUnits(getSegmentAtTick(tick), tick), sampleRate, 1000000LL * m_ticksPerQuarterNote);
+}
+
+void TempoMap::ticksToNanoseconds(std::span<const int> ticks, std::span<std::int64_t> nanoseconds) const {
+    requireOutputSize(ticks.size(), nanoseconds.size(), "TempoMap::ticksToNanoseconds");
+    forEachTickRun(*this, ticks, [&](const Segment& segment, std::size_t begin, std::size_t end) {
+        for (std::size_t j = begin; j < end; j++) {
+            nanoseconds[j] = scaleDown(getTimeUnits(segment, ticks[j]), 1000, m_ticksPerQuarterNote);
+        }
+    });
+}
+
+void TempoMap::ticksToSamples(std::span<const int> ticks, int sampleRate, std::span<std::int64_t> samples) const {
+    requireOutputSize(ticks.size(), samples.size(), "TempoMap::ticksToSamples");
+    const std::int64_t unitsPerSecond = 1000000LL * m_ticksPerQuarterNote;
+    forEachTickRun(*this, ticks, [&](const Segment& segment, std::size_t begin, std::size_t end) {
+        for (std::size_t j = begin; j < end; j++) {
+            samples[j] = scaleDown(getTimeUnits(segment, ticks[j]), sampleRate, unitsPerSecond);
+        }
+    });
+}
+
+}// namespace imp
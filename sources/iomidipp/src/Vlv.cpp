@@ -0,0 +1,81 @@
+/**
+ * @copyright 2020-2020, Christoph Fröhner under BSD-2 license
+ */
+
+#include <iomidipp/Vlv.h>
+
+namespace imp::File {
+
+// decodeDeltaTimes -- Only the length of each message is needed to find
+//    the next delta time: channel messages have a fixed length given by
+//    the command nibble, meta and sysex messages carry a VLV length.
+bool decodeDeltaTimes(std::span<const uchar> chunk, std::vector<int>& ticks) {
+    const uchar* pos = chunk.data();
+    const uchar* end = pos + chunk.size();
+    ulong tick = 0;
+    uchar runningCommand = 0;
+    while (pos < end) {
+        ulong delta;
+        std::size_t length = decodeVlv(pos, end, delta);
+        if (length == 0) {
+            return false;
+        }
+        pos += length;
+        tick += delta;
+        ticks.push_back((int) tick);
+
+        if (pos >= end) {
+            return false;
+        }
+        if (*pos < 0x80) {
+            // running status: the data bytes start right here
+            if (runningCommand == 0 || runningCommand >= 0xf0) {
+                return false;
+            }
+        } else {
+            runningCommand = *pos++;
+        }
+
+        ulong dataBytes = 0;
+        switch (runningCommand & 0xf0) {
+            case 0xC0:
+            case 0xD0:
+                dataBytes = 1;
+                break;
+            case 0xF0:
+                if (runningCommand == 0xff) {
+                    if (pos >= end) {
+                        return false;
+                    }
+                    uchar type = *pos++;
+                    length = decodeVlv(pos, end, dataBytes);
+                    if (length == 0 || (ulong) (end - pos - length) < dataBytes) {
+                        return false;
+                    }
+                    pos += length + dataBytes;
+                    if (type == 0x2f) {
+                        return true;
+                    }
+                    continue;
+                }
+                if (runningCommand == 0xf0 || runningCommand == 0xf7) {
+                    length = decodeVlv(pos, end, dataBytes);
+                    if (length == 0) {
+                        return false;
+                    }
+                    pos += length;
+                }
+                break;
+            default:
+                dataBytes = 2;
+                break;
+        }
+        if ((ulong) (end - pos) < dataBytes) {
+            return false;
+        }
+        pos += dataBytes;
+    }
+    return true;
+}
+
+}// namespace imp::File
@@ -0,0 +1,39 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/ColumnarTrack.h>
+#include <iomidipp/MidiFile.h>
+
+TEST_CASE("Convert tracks to columns and back") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    data.doTimeAnalysis();
+    data.linkNotePairs();
+
+    for (int track = 0; track < data.getNumberOfTracks(); track++) {
+        imp::ColumnarTrack columns(data[track]);
+        REQUIRE(columns.size() == data[track].size());
+
+        imp::MidiEventList list = columns.toEventList();
+        REQUIRE(list.size() == data[track].size());
+        for (std::size_t i = 0; i < list.size(); i++) {
+            REQUIRE(columns.getMessageSize(i) == data[track][i].getSize());
+            REQUIRE(list[i].tick == data[track][i].tick);
+            REQUIRE(list[i].track == data[track][i].track);
+            REQUIRE(list[i].seq == data[track][i].seq);
+            REQUIRE(list[i].seconds == data[track][i].seconds);
+            REQUIRE(!list[i].isLinked());
+            REQUIRE(list[i].getSize() == data[track][i].getSize());
+            for (int b = 0; b < (int) list[i].getSize(); b++) {
+                REQUIRE(list[i][b] == data[track][i][b]);
+            }
+        }
+
+        auto noteOns = columns.findCommand(0x90);
+        std::size_t expected = 0;
+        for (auto const& event : data[track]) {
+            expected += event.isNoteOn() ? 1 : 0;
+        }
+        REQUIRE(noteOns.size() == expected);
+        for (auto i : noteOns) {
+            REQUIRE(data[track][i].isNoteOn());
+        }
+    }
+}
@@ -0,0 +1,48 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/EventCursor.h>
+#include <iomidipp/MidiFile.h>
+
+TEST_CASE("Stream events from a midi file without building MidiData") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+
+    WHEN("Events are pulled in file order") {
+        imp::File::EventCursor cursor("testdata/scratch.mid");
+        THEN("They match the events of the read file track by track") {
+            REQUIRE(cursor.getTrackCount() == data.getNumberOfTracks());
+            REQUIRE(cursor.getTicksPerQuarterNote() == data.getTicksPerQuarterNote());
+            imp::File::StreamEvent event;
+            for (int track = 0; track < data.getNumberOfTracks(); track++) {
+                for (auto const& expected : data[track]) {
+                    REQUIRE(cursor.next(event));
+                    REQUIRE(event.track == track);
+                    REQUIRE(event.tick == expected.tick);
+                    REQUIRE(event.message.getSize() == expected.getSize());
+                    REQUIRE(event.message.getP0() == expected.getP0());
+                    REQUIRE(event.message.getP1() == expected.getP1());
+                    REQUIRE(event.message.getP2() == expected.getP2());
+                    REQUIRE(event.message.isNoteOn() == expected.isNoteOn());
+                }
+            }
+            REQUIRE(!cursor.next(event));
+            REQUIRE(!cursor.failed());
+        }
+    }
+
+    WHEN("Events are pulled merged in time order") {
+        imp::File::MergedEventCursor cursor("testdata/scratch.mid");
+        data.joinTracks();
+        THEN("They come in the same order as in the joined track") {
+            imp::File::StreamEvent event;
+            for (auto const& expected : data[0]) {
+                REQUIRE(cursor.next(event));
+                REQUIRE(event.track == expected.track);
+                REQUIRE(event.tick == expected.tick);
+                REQUIRE(event.message.toMessage().getSize() == expected.getSize());
+                REQUIRE(event.message.getP0() == expected.getP0());
+                REQUIRE(event.message.getP1() == expected.getP1());
+            }
+            REQUIRE(!cursor.next(event));
+            REQUIRE(!cursor.failed());
+        }
+    }
+}
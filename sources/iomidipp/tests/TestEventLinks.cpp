@@ -0,0 +1,222 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/MidiFile.h>
+#include <algorithm>
+#include <map>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct NoteDuration {
+    int ticks;
+    double seconds;
+
+    bool operator==(const NoteDuration&) const = default;
+};
+
+// durations of all note-ons by (track, seq):
+std::map<std::pair<int, int>, NoteDuration> noteDurations(imp::MidiData& data) {
+    std::map<std::pair<int, int>, NoteDuration> durations;
+    for (int track = 0; track < data.getNumberOfTracks(); track++) {
+        for (int i = 0; i < (int) data[track].size(); i++) {
+            const auto& event = data[track][i];
+            if (event.isNoteOn() && event.isLinked()) {
+                durations[{event.track, event.seq}] = {event.getTickDuration(), event.getDurationInSeconds()};
+                auto* partner = data.getLinkedEvent(track, i);
+                REQUIRE(partner != nullptr);
+                REQUIRE(partner->isNoteOff());
+                REQUIRE(partner->getKeyNumber() == event.getKeyNumber());
+                REQUIRE(partner->tick - event.tick == event.getTickDuration());
+            }
+        }
+    }
+    return durations;
+}
+
+}// namespace
+
+TEST_CASE("Linked events stay linked when the events are rearranged") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    data.doTimeAnalysis();
+    REQUIRE(data.linkNotePairs() > 0);
+    auto expected = noteDurations(data);
+    REQUIRE(!expected.empty());
+
+    WHEN("The data is copied and its tracks are shuffled and sorted") {
+        imp::MidiData copy = data;
+        std::mt19937 random(5);
+        for (auto& track : copy.tracks()) {
+            std::shuffle(track.begin(), track.end(), random);
+        }
+        copy.sortTracks();
+        THEN("Every note keeps its duration and partner") {
+            REQUIRE(noteDurations(copy) == expected);
+        }
+    }
+    WHEN("The tracks are joined and the track storage grows") {
+        data.joinTracks();
+        data[0].shrink_to_fit();
+        data[0].push_back(imp::MidiEvent(0xc0, 1));
+        THEN("Every note keeps its duration and partner") {
+            REQUIRE(noteDurations(data) == expected);
+        }
+    }
+}
+
+TEST_CASE("Linked events follow tempo changes") {
+    imp::MidiData data;
+    data.tracks().resize(1);
+    data.setTicksPerQuarterNote(100);
+    imp::MidiEvent noteOn(0x90, 60, 64);
+    imp::MidiEvent noteOff(0x80, 60, 0);
+    noteOff.tick = 200;
+    data.addEvent(0, noteOn);
+    data.addEvent(0, noteOff);
+    data.linkNotePairs();
+    data.doTimeAnalysis();
+    REQUIRE(data[0][0].isLinked());
+    REQUIRE(data[0][0].getTickDuration() == 200);
+    REQUIRE_THAT(data[0][0].getDurationInSeconds(), Catch::Matchers::WithinAbs(1.0, 1e-9));
+
+    WHEN("A tempo change is added") {
+        imp::MidiEvent tempo;
+        tempo.makeTempo(60.0);
+        data.insertEvent(0, tempo);
+        data.doTimeAnalysis();
+        THEN("The duration in seconds is updated") {
+            REQUIRE_THAT(data[0][2].getDurationInSeconds(), Catch::Matchers::WithinAbs(2.0, 1e-9));
+        }
+    }
+    WHEN("The links are cleared") {
+        data.clearLinks();
+        THEN("The events are no longer linked") {
+            REQUIRE(!data[0][0].isLinked());
+            REQUIRE(data[0][0].getTickDuration() == 0);
+            REQUIRE(data.getLinkedEvent(0, 0) == nullptr);
+        }
+    }
+}
+
+TEST_CASE("Link note pairs with a reused workspace") {
+    imp::MidiEventList list;
+    std::vector<std::vector<imp::uchar>> messages = {
+            {0x90, 60, 64},  // note 1 on
+            {0x90, 60, 70},  // note 2 on, same key
+            {0xb0, 64, 127}, // sustain on
+            {0x80, 60, 0},   // note 2 off
+            {0x90, 60, 0},   // note 1 off
+            {0xb0, 64, 0}};  // sustain off
+    for (int i = 0; i < (int) messages.size(); i++) {
+        list.emplace_back(i * 10, 0, messages[i]);
+    }
+    imp::LinkWorkspace workspace;
+    imp::MidiEventList other = list;
+    other.resize(2);
+    REQUIRE(imp::linkNotePairs(other, workspace) == 0);
+
+    THEN("The last note-on is ended by the first note-off, controllers are linked as well") {
+        REQUIRE(imp::linkNotePairs(list, workspace) == 2);
+        REQUIRE(imp::findLinkedEvent(list, 1) == 3);
+        REQUIRE(imp::findLinkedEvent(list, 0) == 4);
+        REQUIRE(imp::findLinkedEvent(list, 2) == 5);
+        REQUIRE(list[0].getTickDuration() == 40);
+        REQUIRE(list[1].getTickDuration() == 20);
+    }
+}
+
+TEST_CASE("Unlink and relink both events of a pair") {
+    imp::MidiData data;
+    data.tracks().resize(1);
+    std::vector<std::vector<imp::uchar>> messages = {
+            {0x90, 60, 64},// note 1 on
+            {0x90, 62, 64},// note 2 on
+            {0x80, 60, 0}, // note 1 off
+            {0x80, 62, 0}};// note 2 off
+    for (int i = 0; i < (int) messages.size(); i++) {
+        data.addEvent(0, i * 10, messages[i]);
+    }
+    REQUIRE(data.linkNotePairs() == 2);
+
+    WHEN("An event is unlinked through the data") {
+        data.unlinkEvent(0, 0);
+        THEN("Its partner is unlinked as well") {
+            REQUIRE(!data[0][0].isLinked());
+            REQUIRE(!data[0][2].isLinked());
+            REQUIRE(data[0][2].getTickDuration() == 0);
+            REQUIRE(data[0][1].isLinked());
+        }
+    }
+    WHEN("An event is deleted") {
+        data.deleteEvent(0, 2);
+        THEN("Its partner is unlinked") {
+            REQUIRE(!data[0][0].isLinked());
+            REQUIRE(data.getLinkedEvent(0, 1) == &data[0][2]);
+        }
+    }
+    WHEN("Two events of different pairs are linked") {
+        imp::linkEvents(data.tracks()[0], 0, 3);
+        THEN("Their previous partners are unlinked") {
+            REQUIRE(imp::findLinkedEvent(data[0], 0) == 3);
+            REQUIRE(!data[0][1].isLinked());
+            REQUIRE(!data[0][2].isLinked());
+            REQUIRE(data[0][0].getTickDuration() == 30);
+        }
+    }
+    WHEN("A tick is edited directly") {
+        data.tracks()[0][2].tick = 50;
+        data.updateLinks();
+        THEN("The durations are refreshed") {
+            REQUIRE(data[0][0].getTickDuration() == 50);
+            REQUIRE(data[0][2].getTickDuration() == 50);
+        }
+    }
+    WHEN("The events are moved by sorting") {
+        data.tracks()[0][2].tick = 50;
+        data.updateLinks();
+        data.sortTracks();
+        THEN("Durations and partners follow the events") {
+            REQUIRE(data[0][0].getTickDuration() == 50);
+            REQUIRE(data.getLinkedEvent(0, 0) == &data[0][3]);
+            REQUIRE(data.getLinkedEvent(0, 3) == &data[0][0]);
+        }
+    }
+}
+
+TEST_CASE("Copies of linked events added to a track are not linked") {
+    imp::MidiData data;
+    data.tracks().resize(1);
+    std::vector<imp::uchar> noteOn = {0x90, 60, 64};
+    std::vector<imp::uchar> noteOff = {0x80, 60, 0};
+    data.addEvent(0, 0, noteOn);
+    data.addEvent(0, 100, noteOff);
+    REQUIRE(data.linkNotePairs() == 1);
+    imp::MidiEvent copy = data[0][0];
+    copy.tick = 50;
+
+    WHEN("The copy is added and the track is sorted") {
+        data.addEvent(0, copy);
+        data.sortTracks();
+        THEN("The original note keeps its partner") {
+            REQUIRE(!data[0][1].isLinked());
+            REQUIRE(data[0][0].getTickDuration() == 100);
+            REQUIRE(imp::findLinkedEvent(data[0], 0) == 2);
+            REQUIRE(imp::findLinkedEvent(data[0], 1) == -1);
+            REQUIRE(imp::findLinkedEvent(data[0], 2) == 0);
+        }
+    }
+    WHEN("The copy is inserted") {
+        data.insertEvent(0, copy);
+        data.insertEvents(0, {copy});
+        THEN("The original note keeps its partner") {
+            REQUIRE(!data[0][1].isLinked());
+            REQUIRE(!data[0][2].isLinked());
+            REQUIRE(imp::findLinkedEvent(data[0], 0) == 3);
+            REQUIRE(imp::findLinkedEvent(data[0], 3) == 0);
+        }
+    }
+}
+
+TEST_CASE("Links do not make events larger") {
+    REQUIRE(sizeof(imp::MidiEvent) <= 64);
+}
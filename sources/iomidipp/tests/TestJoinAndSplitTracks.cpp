@@ -4,4 +4,54 @@
 
 TEST_CASE("Join tracks and split again, there should not be any spurious events on joined track") {
     // TODO option on split tracks to have events remain on joined track
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    imp::MidiData joined = data;
+    joined.joinTracks();
+
+    WHEN("The tracks are joined") {
+        THEN("All events are in one track in time order") {
+            REQUIRE(joined.getNumberOfTracks() == 1);
+            std::size_t total = 0;
+            for (const auto& track : data.tracks()) {
+                total += track.size();
+            }
+            REQUIRE(joined[0].size() == total);
+            for (std::size_t i = 1; i < joined[0].size(); i++) {
+                REQUIRE(imp::eventCompare(joined[0][i - 1], joined[0][i]) <= 0);
+            }
+        }
+    }
+    WHEN("The joined tracks are split again") {
+        joined.splitTracks();
+        THEN("Every track has its original events") {
+            REQUIRE(joined.getNumberOfTracks() == data.getNumberOfTracks());
+            for (int track = 0; track < data.getNumberOfTracks(); track++) {
+                REQUIRE(joined[track].size() == data[track].size());
+                for (int i = 0; i < (int) data[track].size(); i++) {
+                    REQUIRE(joined[track][i].tick == data[track][i].tick);
+                    REQUIRE(joined[track][i].seq == data[track][i].seq);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Join unsorted tracks without sequence numbers") {
+    imp::MidiData data;
+    data.tracks().resize(3);
+    std::vector<imp::uchar> note = {0x90, 60, 100};
+    for (int track = 2; track >= 0; track--) {
+        for (int tick = 100; tick >= 0; tick -= 10) {
+            data.addEvent(track, tick, note);
+        }
+    }
+    data.joinTracks();
+
+    THEN("Events at the same tick are in track order") {
+        REQUIRE(data[0].size() == 33);
+        for (std::size_t i = 0; i < data[0].size(); i++) {
+            REQUIRE(data[0][i].tick == (int) (i / 3) * 10);
+            REQUIRE(data[0][i].track == (int) (i % 3));
+        }
+    }
 }
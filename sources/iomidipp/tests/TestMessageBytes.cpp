@@ -0,0 +1,46 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/MidiMessage.h>
+#include <utility>
+#include <vector>
+
+TEST_CASE("Message bytes are stored inline until they outgrow the object") {
+    REQUIRE(sizeof(imp::MessageBytes) <= sizeof(std::vector<imp::uchar>));
+
+    WHEN("A channel message is created") {
+        imp::MidiMessage message(0x90, 60, 100);
+        THEN("It keeps the usual accessors") {
+            REQUIRE(message.getSize() == 3);
+            REQUIRE(message.getP0() == 0x90);
+            REQUIRE(message[1] == 60);
+            REQUIRE(message.getP2() == 100);
+            REQUIRE(message.isNoteOn());
+        }
+    }
+
+    WHEN("A long meta message is created and copied") {
+        std::vector<imp::uchar> bytes{0xff, 0x01, 0x81, 0x48};
+        bytes.insert(bytes.end(), 200, 'a');
+        imp::MidiMessage message(bytes);
+        imp::MidiMessage copy = message;
+        imp::MidiMessage moved = std::move(copy);
+        THEN("The payload moves to the heap and survives copies and moves") {
+            REQUIRE(message.getSize() == 2 + 2 + 200);
+            REQUIRE(moved.getSize() == message.getSize());
+            REQUIRE(moved.getMetaContent() == std::string(200, 'a'));
+        }
+    }
+
+    WHEN("Bytes are appended one by one past the inline capacity") {
+        imp::MessageBytes bytes;
+        for (int i = 0; i < 40; i++) {
+            bytes.push_back((imp::uchar) i);
+        }
+        THEN("All bytes are kept in order") {
+            REQUIRE(bytes.size() == 40);
+            for (int i = 0; i < 40; i++) {
+                REQUIRE(bytes[i] == i);
+            }
+            REQUIRE_THROWS_AS(bytes.at(40), std::out_of_range);
+        }
+    }
+}
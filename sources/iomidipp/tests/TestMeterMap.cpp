@@ -0,0 +1,64 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/MeterMap.h>
+#include <iomidipp/MidiFile.h>
+#include <vector>
+
+TEST_CASE("Convert between ticks and bars with a meter map") {
+    // 100 ticks per quarter: 4/4 for two bars, then 6/8 and from tick
+    // 1250 on 3/4, which cuts the second 6/8 bar short
+    imp::MeterMap map(100);
+    map.setTimeSignature(1250, 3, 4);
+    map.setTimeSignature(800, 6, 8);
+
+    WHEN("Ticks are converted to bars and beats") {
+        THEN("Each segment uses its own meter") {
+            REQUIRE(map.getSegments().size() == 3);
+            REQUIRE(map.getSegments()[2].bar == 4);
+            REQUIRE(map.ticksToMusicalTime(0) == imp::MusicalTime{0, 0, 0});
+            REQUIRE(map.ticksToMusicalTime(450) == imp::MusicalTime{1, 0, 50});
+            REQUIRE(map.ticksToMusicalTime(800) == imp::MusicalTime{2, 0, 0});
+            REQUIRE(map.ticksToMusicalTime(925) == imp::MusicalTime{2, 2, 25});
+            REQUIRE(map.ticksToMusicalTime(1100) == imp::MusicalTime{3, 0, 0});
+            REQUIRE(map.ticksToMusicalTime(1249) == imp::MusicalTime{3, 2, 49});
+            REQUIRE(map.ticksToMusicalTime(1250) == imp::MusicalTime{4, 0, 0});
+            REQUIRE(map.ticksToMusicalTime(1700) == imp::MusicalTime{5, 1, 50});
+            REQUIRE(map.ticksToMusicalTime(-1) == imp::MusicalTime{-1, 3, 99});
+        }
+    }
+    WHEN("Bars and beats are converted to ticks") {
+        THEN("The result is the inverse") {
+            for (int tick = -500; tick < 3000; tick += 7) {
+                REQUIRE(map.musicalTimeToTicks(map.ticksToMusicalTime(tick)) == tick);
+            }
+            REQUIRE(map.musicalTimeToTicks({3, 0, 0}) == 1100);
+        }
+    }
+}
+
+TEST_CASE("Get the meter map of midi data") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    auto map = data.getMeterMap();
+
+    WHEN("Every event is converted to bars and back") {
+        THEN("The ticks are the same") {
+            for (const auto& track : data.tracks()) {
+                for (const auto& event : track) {
+                    REQUIRE(map->musicalTimeToTicks(map->ticksToMusicalTime(event.tick)) == event.tick);
+                }
+            }
+        }
+    }
+    WHEN("A time signature is added") {
+        imp::MidiEvent meter;
+        meter.makeTimeSignature(7, 8);
+        meter.tick = data.getTicksPerQuarterNote() * 8;
+        data.addEvent(meter);
+        THEN("The meter map is rebuilt") {
+            auto changed = data.getMeterMap();
+            REQUIRE(changed != map);
+            REQUIRE(changed->getSegmentAtTick(meter.tick).numerator == 7);
+            REQUIRE(changed->getSegmentAtTick(meter.tick).denominator == 8);
+            REQUIRE(map->getSegments().size() + 1 == changed->getSegments().size());
+        }
+    }
+}
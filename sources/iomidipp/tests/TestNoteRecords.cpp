@@ -0,0 +1,61 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/MidiFile.h>
+#include <iomidipp/NoteRecords.h>
+#include <algorithm>
+#include <vector>
+
+TEST_CASE("Extract notes as records") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    std::vector<imp::NoteRecord> notes = imp::extractNotes(data);
+
+    THEN("The notes are those of linkNotePairs(), in onset order, and the events stay unlinked") {
+        std::vector<imp::NoteRecord> expected;
+        for (int track = 0; track < data.getNumberOfTracks(); track++) {
+            REQUIRE(std::none_of(data[track].begin(), data[track].end(), [](const auto& e) { return e.isLinked(); }));
+        }
+        imp::MidiData linked = data;
+        linked.linkNotePairs();
+        linked.doTimeAnalysis();
+        for (int track = 0; track < linked.getNumberOfTracks(); track++) {
+            for (int i = 0; i < (int) linked[track].size(); i++) {
+                const auto& event = linked[track][i];
+                if (event.isNoteOn() && event.isLinked()) {
+                    const auto* offset = linked.getLinkedEvent(track, i);
+                    expected.push_back({event.tick, offset->tick, event.seconds, offset->seconds, event.track,
+                                        (imp::uchar) event.getKeyNumber(), (imp::uchar) event.getP2(),
+                                        (imp::uchar) event.getChannel()});
+                }
+            }
+        }
+        std::stable_sort(expected.begin(), expected.end(), [](const auto& a, const auto& b) {
+            return a.onsetTick < b.onsetTick;
+        });
+        REQUIRE(!notes.empty());
+        REQUIRE(notes == expected);
+    }
+}
+
+TEST_CASE("Extract notes from an event list") {
+    std::vector<std::vector<imp::uchar>> messages = {
+            {0x90, 60, 64},// note 1 on
+            {0x91, 60, 50},// other channel, never ends
+            {0x90, 60, 70},// note 2 on, same key
+            {0x80, 60, 0}, // note 2 off
+            {0x90, 62, 80},// note 3 on
+            {0x90, 60, 0}, // note 1 off
+            {0x80, 62, 0}, // note 3 off
+            {0x80, 64, 0}};// note-off without note-on
+    imp::MidiEventList list;
+    for (int i = 0; i < (int) messages.size(); i++) {
+        list.emplace_back(i * 10, 2, messages[i]);
+        list.back().seconds = i;
+    }
+    std::vector<imp::NoteRecord> notes = imp::extractNotes(list);
+
+    THEN("Terminated notes come in onset order") {
+        REQUIRE(notes.size() == 3);
+        REQUIRE(notes[0] == imp::NoteRecord{0, 50, 0.0, 5.0, 2, 60, 64, 0});
+        REQUIRE(notes[1] == imp::NoteRecord{20, 30, 2.0, 3.0, 2, 60, 70, 0});
+        REQUIRE(notes[2] == imp::NoteRecord{40, 60, 4.0, 6.0, 2, 62, 80, 0});
+    }
+}
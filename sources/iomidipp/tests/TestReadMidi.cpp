@@ -1,6 +1,13 @@
 #include <catch2/catch_all.hpp>
 #include <iomidipp/MidiFile.h>
+#include <algorithm>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <sstream>
+#include <vector>
 
 TEST_CASE("Read midi file and print output") {
     WHEN("Example file is read and we do common operations") {
@@ -37,3 +44,182 @@ TEST_CASE("Read midi file and print output") {
         }
     }
 }
+
+TEST_CASE("Read midi file from an in-memory buffer") {
+    std::ifstream input("testdata/scratch.mid", std::ios::binary);
+    std::vector<char> buffer{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+    REQUIRE(!buffer.empty());
+
+    imp::MidiData fromFile = imp::File::read("testdata/scratch.mid");
+
+    WHEN("The whole buffer is parsed") {
+        imp::MidiData fromBuffer = imp::File::read(std::as_bytes(std::span(buffer)));
+        THEN("The result is the same as reading the file") {
+            REQUIRE(fromBuffer.getTicksPerQuarterNote() == fromFile.getTicksPerQuarterNote());
+            REQUIRE(fromBuffer.getNumberOfTracks() == fromFile.getNumberOfTracks());
+            for (int track = 0; track < fromFile.getNumberOfTracks(); track++) {
+                REQUIRE(fromBuffer[track].size() == fromFile[track].size());
+                for (int event = 0; event < fromFile[track].size(); event++) {
+                    REQUIRE(fromBuffer[track][event].tick == fromFile[track][event].tick);
+                    REQUIRE(fromBuffer[track][event].getSize() == fromFile[track][event].getSize());
+                }
+            }
+        }
+    }
+    WHEN("The buffer is truncated") {
+        auto truncated = std::as_bytes(std::span(buffer)).first(buffer.size() / 2);
+        imp::MidiData data = imp::File::read(truncated);
+        THEN("Reading stops without running past the end") {
+            REQUIRE(data.getNumberOfTracks() == 0);
+        }
+    }
+}
+
+TEST_CASE("Read midi file with parallel track decoding") {
+    imp::MidiData serial = imp::File::read("testdata/scratch.mid");
+
+    auto requireSameEvents = [&serial](imp::MidiData const& data) {
+        REQUIRE(data.getNumberOfTracks() == serial.getNumberOfTracks());
+        for (int track = 0; track < serial.getNumberOfTracks(); track++) {
+            REQUIRE(data[track].size() == serial[track].size());
+            for (int event = 0; event < serial[track].size(); event++) {
+                REQUIRE(data[track][event].tick == serial[track][event].tick);
+                REQUIRE(data[track][event].track == serial[track][event].track);
+                REQUIRE(data[track][event].seq == serial[track][event].seq);
+                REQUIRE(data[track][event].getSize() == serial[track][event].getSize());
+            }
+        }
+    };
+
+    WHEN("The chunk lengths are consistent") {
+        imp::MidiData parallel = imp::File::read("testdata/scratch.mid", {.parallelTracks = true});
+        THEN("The result is the same as the serial read") {
+            requireSameEvents(parallel);
+        }
+    }
+    WHEN("A chunk length is wrong") {
+        std::ifstream input("testdata/scratch.mid", std::ios::binary);
+        std::vector<char> buffer{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+        // first MTrk length field starts right after the 14-byte header
+        buffer[14 + 7] += 1;
+        imp::MidiData parallel = imp::File::read(std::as_bytes(std::span(buffer)), {.parallelTracks = true});
+        THEN("The reader falls back to the serial path") {
+            requireSameEvents(parallel);
+        }
+    }
+    WHEN("A track contains a bad data byte") {
+        imp::MidiData data;
+        data.tracks().resize(2);
+        std::vector<imp::uchar> note = {0x90, 60, 64};
+        data.addEvent(1, 0, note);
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data);
+        auto velocity = std::search(buffer.begin(), buffer.end(), note.begin(), note.end()) + 2;
+        *velocity = 0xc0;
+        auto errors = [&buffer](bool parallelTracks) {
+            std::ostringstream output;
+            std::streambuf* old = std::cerr.rdbuf(output.rdbuf());
+            imp::MidiData read = imp::File::read(std::as_bytes(std::span(buffer)), {.parallelTracks = parallelTracks});
+            std::cerr.rdbuf(old);
+            return output.str();
+        };
+        THEN("Only the serial fallback reports the error") {
+            REQUIRE(!errors(false).empty());
+            REQUIRE(errors(true) == errors(false));
+        }
+    }
+}
+
+TEST_CASE("Read midi file into a payload arena") {
+    // one track with a long lyric and a long sysex message around a note
+    std::vector<unsigned char> track = {0x00, 0xff, 0x05, 32};
+    for (int i = 0; i < 32; i++) {
+        track.push_back('a' + i % 26);
+    }
+    track.insert(track.end(), {0x00, 0xf0, 20});
+    for (int i = 0; i < 19; i++) {
+        track.push_back(i);
+    }
+    track.insert(track.end(), {0xf7, 0x00, 0x90, 0x3c, 0x40, 0x60, 0x80, 0x3c, 0x00, 0x00, 0xff, 0x2f, 0x00});
+    std::vector<unsigned char> buffer = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 0, 0, 1, 0, 96,
+                                         'M', 'T', 'r', 'k', 0, 0, 0, (unsigned char) track.size()};
+    buffer.insert(buffer.end(), track.begin(), track.end());
+    auto bytes = std::as_bytes(std::span(buffer));
+
+    imp::MidiData plain = imp::File::read(bytes);
+    REQUIRE(plain.getNumberOfTracks() == 1);
+    REQUIRE(plain[0].size() == 5);
+
+    auto requireSameBytes = [&plain](imp::MidiData const& data) {
+        REQUIRE(data.getNumberOfTracks() == plain.getNumberOfTracks());
+        REQUIRE(data[0].size() == plain[0].size());
+        for (int event = 0; event < plain[0].size(); event++) {
+            REQUIRE(data[0][event].getSize() == plain[0][event].getSize());
+            for (int i = 0; i < plain[0][event].getSize(); i++) {
+                REQUIRE(data[0][event][i] == plain[0][event][i]);
+            }
+        }
+    };
+
+    WHEN("Long messages are read into the arena") {
+        imp::MidiData copy;
+        {
+            imp::MidiData data = imp::File::read(bytes, {.payloadArena = true});
+            REQUIRE(data.getPayloadArena() != nullptr);
+            REQUIRE(data.getPayloadArena()->getUsedBytes() == 35 + 21);
+            REQUIRE(data[0][0].isContentBorrowed());
+            REQUIRE(data[0][1].isContentBorrowed());
+            REQUIRE(!data[0][2].isContentBorrowed());
+            requireSameBytes(data);
+            copy = data;
+        }
+        THEN("A copy keeps the arena alive") {
+            requireSameBytes(copy);
+        }
+        THEN("Modifying a borrowed message leaves other copies alone") {
+            imp::MidiData other = copy;
+            other[0][0][4] = 'z';
+            REQUIRE(!other[0][0].isContentBorrowed());
+            REQUIRE(copy[0][0].isContentBorrowed());
+            requireSameBytes(copy);
+        }
+        THEN("A copy keeps borrowing from the arena") {
+            REQUIRE(copy[0][0].isContentBorrowed());
+            REQUIRE(copy[0][1].isContentBorrowed());
+        }
+        THEN("Detached events no longer need the arena") {
+            copy.detachPayloads();
+            REQUIRE(copy.getPayloadArena() == nullptr);
+            REQUIRE(!copy[0][0].isContentBorrowed());
+            requireSameBytes(copy);
+        }
+        THEN("Replacing the arena detaches the events from the old one") {
+            copy.setPayloadArena(std::make_shared<imp::PayloadArena>());
+            REQUIRE(!copy[0][0].isContentBorrowed());
+            REQUIRE(!copy[0][1].isContentBorrowed());
+            requireSameBytes(copy);
+        }
+    }
+    WHEN("A track and an event are copied out of data read into the arena") {
+        imp::MidiEventList track;
+        imp::MidiEvent event;
+        {
+            imp::MidiData data = imp::File::read(bytes, {.payloadArena = true});
+            track = data[0];
+            event = data[0][0];
+        }
+        THEN("Tracks and events copied out of the data own their bytes") {
+            REQUIRE(!track[0].isContentBorrowed());
+            REQUIRE(!track[1].isContentBorrowed());
+            REQUIRE(!event.isContentBorrowed());
+            REQUIRE(track.size() == plain[0].size());
+            for (int i = 0; i < plain[0].size(); i++) {
+                REQUIRE(track[i].getSize() == plain[0][i].getSize());
+                for (int k = 0; k < plain[0][i].getSize(); k++) {
+                    REQUIRE(track[i][k] == plain[0][i][k]);
+                }
+            }
+            REQUIRE(event.getSize() == plain[0][0].getSize());
+            REQUIRE(event[4] == plain[0][0][4]);
+        }
+    }
+}
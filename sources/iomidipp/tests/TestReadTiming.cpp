@@ -0,0 +1,80 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/EventCursor.h>
+#include <iomidipp/MidiFile.h>
+#include <span>
+#include <vector>
+
+TEST_CASE("Read only the timing of a midi file") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    imp::File::Timing timing = imp::File::readTiming("testdata/scratch.mid");
+
+    WHEN("The timing is compared with the full midi data") {
+        THEN("Duration, tempo and meter are the same") {
+            REQUIRE(timing.ticksPerQuarterNote == data.getTicksPerQuarterNote());
+            REQUIRE(!timing.failed);
+            REQUIRE(timing.smpteFramesPerSecond == 0);
+            REQUIRE(timing.durationInTicks == data.getFileDurationInTicks());
+            REQUIRE(timing.durationInSeconds == data.getFileDurationInSeconds());
+            auto tempoMap = data.getTempoMap();
+            REQUIRE(timing.tempoMap->getSegments().size() == tempoMap->getSegments().size());
+            for (std::size_t i = 0; i < tempoMap->getSegments().size(); i++) {
+                REQUIRE(timing.tempoMap->getSegments()[i].tick == tempoMap->getSegments()[i].tick);
+                REQUIRE(timing.tempoMap->getSegments()[i].microsecondsPerQuarter == tempoMap->getSegments()[i].microsecondsPerQuarter);
+            }
+            auto meterMap = data.getMeterMap();
+            REQUIRE(timing.meterMap->getSegments().size() == meterMap->getSegments().size());
+            for (std::size_t i = 0; i < meterMap->getSegments().size(); i++) {
+                REQUIRE(timing.meterMap->getSegments()[i].tick == meterMap->getSegments()[i].tick);
+                REQUIRE(timing.meterMap->getSegments()[i].numerator == meterMap->getSegments()[i].numerator);
+                REQUIRE(timing.meterMap->getSegments()[i].denominator == meterMap->getSegments()[i].denominator);
+            }
+        }
+    }
+    WHEN("The file uses running status and an SMPTE time base") {
+        data.setMillisecondTicks();
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data, {.runningStatus = true});
+        timing = imp::File::readTiming(std::as_bytes(std::span(buffer)));
+        THEN("Ticks are milliseconds") {
+            REQUIRE(timing.smpteFramesPerSecond == 25);
+            REQUIRE(timing.smpteSubframes == 40);
+            REQUIRE(timing.durationInTicks == data.getFileDurationInTicks());
+            REQUIRE(timing.durationInSeconds == data.getFileDurationInSeconds());
+        }
+    }
+    WHEN("A track is cut off") {
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data);
+        buffer.resize(buffer.size() - 10);
+        buffer.back() = 0x90;
+        THEN("The failure is reported like by the event cursors") {
+            imp::File::Timing timing;
+            REQUIRE_NOTHROW(timing = imp::File::readTiming(std::as_bytes(std::span(buffer))));
+            REQUIRE(timing.failed);
+            REQUIRE(timing.tempoMap != nullptr);
+            REQUIRE(timing.durationInTicks <= data.getFileDurationInTicks());
+
+            imp::File::EventCursor cursor(std::as_bytes(std::span(buffer)));
+            imp::File::StreamEvent event;
+            while (cursor.next(event)) {
+            }
+            REQUIRE(cursor.failed());
+        }
+    }
+    WHEN("The header is broken") {
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data);
+        buffer[1] = 'X';
+        THEN("An exception is thrown") {
+            REQUIRE_THROWS(imp::File::readTiming(std::as_bytes(std::span(buffer))));
+        }
+    }
+}
+
+TEST_CASE("Benchmark reading the duration of a file", "[.][benchmark]") {
+    BENCHMARK("read and getFileDurationInSeconds") {
+        imp::MidiData data = imp::File::read("testdata/scratch.mid");
+        return data.getFileDurationInSeconds();
+    };
+
+    BENCHMARK("readTiming") {
+        return imp::File::readTiming("testdata/scratch.mid").durationInSeconds;
+    };
+}
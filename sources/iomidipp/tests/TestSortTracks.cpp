@@ -0,0 +1,243 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/MidiFile.h>
+#include <algorithm>
+#include <cstdlib>
+#include <random>
+#include <utility>
+#include <vector>
+
+TEST_CASE("Sort events by tick and sequence number") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    std::mt19937 random(17);
+
+    WHEN("The events of every track are shuffled and sorted") {
+        imp::MidiData shuffled = data;
+        for (auto& track : shuffled.tracks()) {
+            std::shuffle(track.begin(), track.end(), random);
+            imp::sort(track);
+        }
+        THEN("The original file order comes back") {
+            for (int track = 0; track < data.getNumberOfTracks(); track++) {
+                REQUIRE(shuffled[track].size() == data[track].size());
+                for (std::size_t i = 0; i < data[track].size(); i++) {
+                    REQUIRE(shuffled[track][i].seq == data[track][i].seq);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Sort events at the same tick by their kind") {
+    std::vector<std::vector<imp::uchar>> messages = {
+            {0xff, 0x51, 0x03, 0x07, 0xa1, 0x20},// tempo
+            {0xc0, 0x05},                        // program change
+            {0xb0, 0x07, 0x03},                  // volume
+            {0xb0, 0x0a, 0x05},                  // pan
+            {0x90, 0x3c, 0x00},                  // note-off
+            {0x90, 0x3c, 0x40},                  // note-on
+            {0xff, 0x2f, 0x00}};                 // end of track
+    imp::MidiEventList list;
+    for (int tick = 0; tick < 3; tick++) {
+        for (auto& message : messages) {
+            list.emplace_back(tick, 0, message);
+        }
+    }
+    std::shuffle(list.begin(), list.end(), std::mt19937(3));
+
+    WHEN("The events have no sequence numbers") {
+        imp::sort(list);
+        THEN("Meta messages come first, then controllers, note-offs, note-ons and the end of track") {
+            for (std::size_t i = 0; i < list.size(); i++) {
+                REQUIRE(list[i].tick == (int) (i / messages.size()));
+                const auto& message = messages[i % messages.size()];
+                REQUIRE(list[i].getSize() == (int) message.size());
+                for (std::size_t j = 0; j < message.size(); j++) {
+                    REQUIRE(list[i][j] == message[j]);
+                }
+            }
+        }
+    }
+    WHEN("Only some events have a sequence number") {
+        for (std::size_t i = 0; i < list.size(); i += 2) {
+            list[i].seq = (int) (list.size() - i);
+        }
+        imp::sort(list);
+        THEN("No event is before one that compares less") {
+            for (std::size_t i = 1; i < list.size(); i++) {
+                REQUIRE(imp::eventCompare(list[i - 1], list[i]) <= 0);
+            }
+        }
+    }
+}
+
+TEST_CASE("Sort a large track on several threads") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    data.joinTracks();
+    // many copies of the joined track with overlapping ticks
+    imp::MidiEventList large;
+    for (int copy = 0; copy < 40; copy++) {
+        for (const auto& event : data[0]) {
+            large.push_back(event);
+            large.back().tick += copy * 100;
+            large.back().seq += copy * (int) data[0].size();
+        }
+    }
+    std::shuffle(large.begin(), large.end(), std::mt19937(5));
+
+    WHEN("The events have sequence numbers") {
+        imp::MidiEventList serial = large;
+        imp::MidiEventList parallel = large;
+        imp::sort(serial);
+        imp::sort(parallel, true);
+        THEN("The order is the same as when sorted on one thread") {
+            for (std::size_t i = 0; i < large.size(); i++) {
+                REQUIRE(parallel[i].seq == serial[i].seq);
+            }
+        }
+    }
+    WHEN("The events have no sequence numbers") {
+        imp::clearSequence(large);
+        for (std::size_t i = 0; i < large.size(); i++) {
+            large[i].track = (int) i;
+        }
+        imp::MidiEventList serial = large;
+        imp::MidiEventList parallel = large;
+        imp::sort(serial);
+        imp::sort(parallel, true);
+        THEN("Equal events are in the same order as well") {
+            for (std::size_t i = 0; i < large.size(); i++) {
+                REQUIRE(parallel[i].track == serial[i].track);
+            }
+        }
+    }
+    WHEN("A file with one large track and several small ones is sorted") {
+        imp::MidiData serial = imp::File::read("testdata/scratch.mid");
+        serial.tracks()[0] = large;
+        for (auto& track : serial.tracks()) {
+            std::shuffle(track.begin(), track.end(), std::mt19937(9));
+        }
+        imp::MidiData parallel = serial;
+        serial.sortTracks();
+        parallel.sortTracks(true);
+        THEN("Every track is in the same order as when sorted on one thread") {
+            for (int track = 0; track < (int) serial.getNumberOfTracks(); track++) {
+                REQUIRE(parallel[track].size() == serial[track].size());
+                for (std::size_t i = 0; i < serial[track].size(); i++) {
+                    REQUIRE(parallel[track][i].seq == serial[track][i].seq);
+                    REQUIRE(parallel[track][i].tick == serial[track][i].tick);
+                }
+            }
+        }
+    }
+}
+
+TEST_CASE("Insert events into sorted tracks") {
+    std::mt19937 random(11);
+    std::uniform_int_distribution<int> ticks(0, 2000);
+    imp::MidiEventList notes;
+    for (int i = 0; i < 500; i++) {
+        notes.emplace_back(0x90, i % 128, 64);
+        notes.back().tick = ticks(random);
+    }
+
+    WHEN("Events are inserted one by one into data without sequence numbers") {
+        imp::MidiData data;
+        data.tracks().resize(1);
+        for (const auto& note : notes) {
+            data.insertEvent(0, note);
+        }
+        imp::MidiEventList sorted = notes;
+        imp::sort(sorted);
+        THEN("The track is the same as after sorting") {
+            REQUIRE(data[0].size() == sorted.size());
+            for (std::size_t i = 0; i < sorted.size(); i++) {
+                REQUIRE(data[0][i].tick == sorted[i].tick);
+                REQUIRE(data[0][i].getKeyNumber() == sorted[i].getKeyNumber());
+                REQUIRE(data[0][i].seq == 0);
+            }
+        }
+    }
+    WHEN("A batch of events is merged into a file") {
+        imp::MidiData data = imp::File::read("testdata/scratch.mid");
+        data.doTimeAnalysis();
+        std::size_t size = data[1].size();
+        data.insertEvents(1, notes);
+        THEN("The track stays sorted with consistent sequence numbers") {
+            REQUIRE(data[1].size() == size + notes.size());
+            for (std::size_t i = 1; i < data[1].size(); i++) {
+                REQUIRE(imp::eventCompare(data[1][i - 1], data[1][i]) < 0);
+            }
+            auto map = data.getTempoMap();
+            for (const auto& event : data[1]) {
+                REQUIRE(event.seq != 0);
+                REQUIRE(event.seconds == map->ticksToSeconds(event.tick));
+            }
+        }
+    }
+    WHEN("Events are inserted one by one into linked data") {
+        imp::MidiData data = imp::File::read("testdata/scratch.mid");
+        REQUIRE(data.linkNotePairs() > 0);
+        std::vector<std::pair<int, int>> durations;
+        for (const auto& event : data[1]) {
+            if (event.isLinked()) {
+                durations.emplace_back(event.seq, event.getTickDuration());
+            }
+        }
+        for (const auto& note : notes) {
+            data.insertEvent(1, note);
+        }
+        THEN("The inserted events are not linked and the other links are kept") {
+            std::vector<std::pair<int, int>> kept;
+            for (int i = 0; i < (int) data[1].size(); i++) {
+                const auto& event = data[1][i];
+                if (event.isLinked()) {
+                    kept.emplace_back(event.seq, event.getTickDuration());
+                    const auto* partner = data.getLinkedEvent(1, i);
+                    REQUIRE(partner != nullptr);
+                    REQUIRE(std::abs(partner->tick - event.tick) == event.getTickDuration());
+                }
+            }
+            REQUIRE(kept == durations);
+        }
+    }
+}
+
+TEST_CASE("Benchmark sorting a joined track", "[.][benchmark]") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    data.joinTracks();
+    imp::MidiEventList shuffled = data[0];
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(1));
+
+    BENCHMARK("std::sort with eventCompare") {
+        imp::MidiEventList list = shuffled;
+        std::sort(list.begin(), list.end(), [](const imp::MidiEvent& a, const imp::MidiEvent& b) {
+            return imp::eventCompare(a, b) < 0;
+        });
+        return list.size();
+    };
+
+    BENCHMARK("imp::sort") {
+        imp::MidiEventList list = shuffled;
+        imp::sort(list);
+        return list.size();
+    };
+
+    for (int copy = 1; copy < 40; copy++) {
+        for (std::size_t i = 0; i < data[0].size(); i++) {
+            shuffled.push_back(shuffled[i]);
+            shuffled.back().seq += copy * (int) data[0].size();
+        }
+    }
+
+    BENCHMARK("imp::sort large track") {
+        imp::MidiEventList list = shuffled;
+        imp::sort(list);
+        return list.size();
+    };
+
+    BENCHMARK("imp::sort large track in parallel") {
+        imp::MidiEventList list = shuffled;
+        imp::sort(list, true);
+        return list.size();
+    };
+}
@@ -0,0 +1,288 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/MidiFile.h>
+#include <iomidipp/TempoMap.h>
+#include <algorithm>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+
+TEST_CASE("Convert between ticks and seconds with a tempo map") {
+    // 100 ticks per quarter: 120 bpm until tick 400, then 60 bpm, then
+    // 240 bpm from tick 600 on
+    imp::TempoMap map(100);
+    map.setTempo(600, 250000);
+    map.setTempo(400, 1000000);
+
+    WHEN("Ticks are converted to seconds") {
+        THEN("Each segment uses its own tempo") {
+            REQUIRE(map.getSegments().size() == 3);
+            REQUIRE_THAT(map.ticksToSeconds(0), Catch::Matchers::WithinAbs(0.0, 1e-9));
+            REQUIRE_THAT(map.ticksToSeconds(200), Catch::Matchers::WithinAbs(1.0, 1e-9));
+            REQUIRE_THAT(map.ticksToSeconds(400), Catch::Matchers::WithinAbs(2.0, 1e-9));
+            REQUIRE_THAT(map.ticksToSeconds(500), Catch::Matchers::WithinAbs(3.0, 1e-9));
+            REQUIRE_THAT(map.ticksToSeconds(600), Catch::Matchers::WithinAbs(4.0, 1e-9));
+            REQUIRE_THAT(map.ticksToSeconds(1000), Catch::Matchers::WithinAbs(5.0, 1e-9));
+            REQUIRE(map.getTempoMicroseconds(599) == 1000000);
+        }
+    }
+    WHEN("Seconds are converted to ticks") {
+        THEN("The conversion is the inverse") {
+            for (int tick = 0; tick < 1200; tick += 25) {
+                REQUIRE_THAT(map.secondsToTicks(map.ticksToSeconds(tick)), Catch::Matchers::WithinAbs(tick, 1e-9));
+            }
+        }
+    }
+    WHEN("A tempo change is replaced") {
+        map.setTempo(400, 500000);
+        THEN("The later segments move") {
+            REQUIRE(map.getSegments().size() == 3);
+            REQUIRE_THAT(map.ticksToSeconds(600), Catch::Matchers::WithinAbs(3.0, 1e-9));
+        }
+    }
+}
+
+TEST_CASE("Query times of a midi file through its tempo map") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    data.doTimeAnalysis();
+    auto map = data.getTempoMap();
+    REQUIRE(map->getTicksPerQuarterNote() == data.getTicksPerQuarterNote());
+
+    THEN("Event times and queries agree") {
+        for (int track = 0; track < data.getNumberOfTracks(); track++) {
+            for (auto const& event : data[track]) {
+                REQUIRE_THAT(data.getTimeInSeconds(event.tick), Catch::Matchers::WithinAbs(event.seconds, 1e-9));
+                REQUIRE_THAT(data.getAbsoluteTickTime(event.seconds), Catch::Matchers::WithinAbs(event.tick, 1e-9));
+            }
+        }
+    }
+    THEN("Times outside of the data are out of range") {
+        REQUIRE(data.getTimeInSeconds(-1) == -1.0);
+        REQUIRE(data.getTimeInSeconds(data.getFileDurationInTicks() + 1) == -1.0);
+        REQUIRE(data.getAbsoluteTickTime(data.getFileDurationInSeconds() + 1.0) == -1.0);
+    }
+}
+
+TEST_CASE("Time analysis leaves the track structure alone") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    std::vector<std::size_t> sizes;
+    for (int track = 0; track < data.getNumberOfTracks(); track++) {
+        sizes.push_back(data[track].size());
+    }
+    data.doTimeAnalysis();
+
+    THEN("Every track keeps its events") {
+        REQUIRE(data.getNumberOfTracks() == sizes.size());
+        for (int track = 0; track < data.getNumberOfTracks(); track++) {
+            REQUIRE(data[track].size() == sizes[track]);
+        }
+    }
+    THEN("Delta ticks give the same times and stay delta ticks") {
+        imp::MidiData delta = data;
+        delta.makeDeltaTicks();
+        delta.doTimeAnalysis();
+        REQUIRE(delta.isDeltaTicks());
+        for (int track = 0; track < data.getNumberOfTracks(); track++) {
+            for (int event = 0; event < data[track].size(); event++) {
+                REQUIRE(delta[track][event].seconds == data[track][event].seconds);
+            }
+        }
+    }
+}
+
+TEST_CASE("Convert many ticks and seconds at once") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    auto map = data.getTempoMap();
+    int end = data.getFileDurationInTicks();
+
+    std::vector<int> ticks;
+    for (int tick = -10; tick <= end + 10; tick += 7) {
+        ticks.push_back(tick);
+    }
+    std::vector<double> seconds(ticks.size());
+    std::vector<double> back(ticks.size());
+
+    WHEN("The ticks are sorted") {
+        data.getTimeInSeconds(ticks, seconds);
+        data.getAbsoluteTickTime(seconds, back);
+        THEN("Each value is the same as converted one by one") {
+            for (std::size_t i = 0; i < ticks.size(); i++) {
+                REQUIRE(seconds[i] == data.getTimeInSeconds(ticks[i]));
+                REQUIRE(back[i] == data.getAbsoluteTickTime(seconds[i]));
+            }
+        }
+    }
+    WHEN("The ticks are in random order") {
+        std::reverse(ticks.begin(), ticks.end());
+        std::swap(ticks[3], ticks[ticks.size() / 2]);
+        map->ticksToSeconds(ticks, seconds);
+        map->secondsToTicks(seconds, back);
+        THEN("The result is still correct") {
+            for (std::size_t i = 0; i < ticks.size(); i++) {
+                REQUIRE(seconds[i] == map->ticksToSeconds(ticks[i]));
+                REQUIRE(back[i] == map->secondsToTicks(seconds[i]));
+            }
+        }
+    }
+    WHEN("The output is smaller than the input") {
+        std::vector<double> shorter(ticks.size() - 1);
+        std::vector<std::int64_t> times(ticks.size() - 1);
+        THEN("Nothing is converted") {
+            REQUIRE_THROWS_AS(data.getTimeInSeconds(ticks, shorter), std::invalid_argument);
+            REQUIRE_THROWS_AS(data.getAbsoluteTickTime(seconds, shorter), std::invalid_argument);
+            REQUIRE_THROWS_AS(data.getTimeInNanoseconds(ticks, times), std::invalid_argument);
+            REQUIRE_THROWS_AS(data.getTimeInSamples(ticks, 44100, times), std::invalid_argument);
+        }
+    }
+}
+
+TEST_CASE("Convert ticks to exact integer times") {
+    // 3 ticks per quarter: a tick at 120 bpm is 1/6 second
+    imp::TempoMap map(3);
+    map.setTempo(3, 333333);
+
+    WHEN("Single ticks are converted") {
+        THEN("The exact time is rounded down") {
+            REQUIRE(map.ticksToNanoseconds(0) == 0);
+            REQUIRE(map.ticksToNanoseconds(1) == 166666666);
+            REQUIRE(map.ticksToNanoseconds(-1) == -166666667);
+            REQUIRE(map.ticksToNanoseconds(4) == 611111000);
+            REQUIRE(map.ticksToSamples(1, 44100) == 7350);
+            REQUIRE(map.ticksToSamples(4, 44100) == 26949);
+        }
+    }
+    WHEN("Many tempo changes add up over a long time") {
+        imp::TempoMap longMap(960);
+        std::int64_t units = 0;
+        for (int i = 0; i < 1000; i++) {
+            longMap.setTempo(i * 9600, 500001 + i);
+            units += 9600LL * (500001 + i);
+        }
+        int tick = 1000 * 9600;
+        THEN("There is no drift") {
+            REQUIRE(longMap.ticksToNanoseconds(tick) == units * 1000 / 960);
+            REQUIRE(longMap.ticksToSamples(tick, 48000) == units * 48000 / 960000000);
+        }
+    }
+    WHEN("Many ticks are converted at once") {
+        std::vector<int> ticks = {0, 1, 2, 3, 4, 100, 5, -1};
+        std::vector<std::int64_t> nanoseconds(ticks.size());
+        std::vector<std::int64_t> samples(ticks.size());
+        map.ticksToNanoseconds(ticks, nanoseconds);
+        map.ticksToSamples(ticks, 48000, samples);
+        THEN("Each value is the same as converted one by one") {
+            for (std::size_t i = 0; i < ticks.size(); i++) {
+                REQUIRE(nanoseconds[i] == map.ticksToNanoseconds(ticks[i]));
+                REQUIRE(samples[i] == map.ticksToSamples(ticks[i], 48000));
+            }
+        }
+    }
+}
+
+TEST_CASE("Update the time map after editing events") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    data.doTimeAnalysis();
+    auto map = data.getTempoMap();
+    int end = data.getFileDurationInTicks();
+
+    WHEN("A note is added") {
+        std::vector<imp::uchar> note = {0x90, 60, 100};
+        data.addEvent(1, end / 2, note);
+        THEN("The tempo map is kept and the note gets its time") {
+            REQUIRE(data.getTempoMap() == map);
+            int last = (int) data.tracks()[1].size() - 1;
+            REQUIRE(data.getTimeInSeconds(1, last) == map->ticksToSeconds(end / 2));
+        }
+    }
+    WHEN("A tempo change is added") {
+        imp::MidiEvent tempo;
+        tempo.makeTempo(30.0);
+        tempo.tick = end / 2;
+        tempo.track = 0;
+        data.addEvent(tempo);
+        imp::MidiData rebuilt = data;
+        rebuilt.invalidateTimeMap();
+        rebuilt.doTimeAnalysis();
+        THEN("Later events are updated as by a full rebuild") {
+            REQUIRE(data.getTempoMap() != map);
+            REQUIRE(data.getFileDurationInSeconds() == rebuilt.getFileDurationInSeconds());
+            REQUIRE(data.getFileDurationInSeconds() > map->ticksToSeconds(end));
+            for (int track = 0; track < (int) data.tracks().size(); track++) {
+                for (int i = 0; i < (int) data.tracks()[track].size(); i++) {
+                    REQUIRE(data.getTimeInSeconds(track, i) == rebuilt.getTimeInSeconds(track, i));
+                }
+            }
+        }
+    }
+    WHEN("The last tempo change is deleted") {
+        int track = 0;
+        int index = -1;
+        for (int i = 0; i < (int) data.tracks()[track].size(); i++) {
+            if (data.getEvent(track, i).isTempo()) {
+                index = i;
+            }
+        }
+        REQUIRE(index >= 0);
+        data.deleteEvent(track, index);
+        imp::MidiData rebuilt = data;
+        rebuilt.invalidateTimeMap();
+        THEN("The time map is the same as after a full rebuild") {
+            REQUIRE(data.getFileDurationInSeconds() == rebuilt.getFileDurationInSeconds());
+            REQUIRE(data.getTempoMap()->getSegments().size() == rebuilt.getTempoMap()->getSegments().size());
+        }
+    }
+}
+
+TEST_CASE("Time analysis after an incremental rebuild starts from the beginning") {
+    imp::MidiData data;
+    data.tracks().resize(1);
+    data.setTicksPerQuarterNote(100);
+    imp::MidiEvent tempo;
+    tempo.makeTempo(120.0);
+    data.addEvent(0, tempo);
+    imp::MidiEvent note(0x90, 60, 64);
+    note.tick = 200;
+    data.addEvent(0, note);
+    data.doTimeAnalysis();
+    REQUIRE_THAT(data[0][1].seconds, Catch::Matchers::WithinAbs(1.0, 1e-9));
+
+    // rebuild the map from tick 150 on, then edit the tempo at tick 0
+    // without invalidating the map
+    data.invalidateTimeMap(150);
+    REQUIRE_THAT(data.getTimeInSeconds(0, 1), Catch::Matchers::WithinAbs(1.0, 1e-9));
+    data[0][0].setTempo(60.0);
+    data.doTimeAnalysis();
+    REQUIRE_THAT(data[0][1].seconds, Catch::Matchers::WithinAbs(2.0, 1e-9));
+
+    WHEN("The map is invalidated from a later tick after the edit") {
+        data[0][0].setTempo(240.0);
+        data.invalidateTimeMap(0);
+        data.getTempoMap();
+        data.invalidateTimeMap(150);
+        THEN("The next rebuild still keeps the edited tempo") {
+            REQUIRE_THAT(data.getTimeInSeconds(0, 1), Catch::Matchers::WithinAbs(0.5, 1e-9));
+        }
+    }
+}
+
+TEST_CASE("Benchmark batch tick conversion", "[.][benchmark]") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    int end = data.getFileDurationInTicks();
+    std::vector<int> ticks(1000000);
+    for (std::size_t i = 0; i < ticks.size(); i++) {
+        ticks[i] = (int) ((long long) i * end / (long long) ticks.size());
+    }
+    std::vector<double> seconds(ticks.size());
+    data.doTimeAnalysis();
+
+    BENCHMARK("getTimeInSeconds one by one") {
+        for (std::size_t i = 0; i < ticks.size(); i++) {
+            seconds[i] = data.getTimeInSeconds(ticks[i]);
+        }
+        return seconds.back();
+    };
+
+    BENCHMARK("getTimeInSeconds batch") {
+        data.getTimeInSeconds(ticks, seconds);
+        return seconds.back();
+    };
+}
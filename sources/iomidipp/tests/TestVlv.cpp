@@ -0,0 +1,151 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/MidiFile.h>
+#include <iomidipp/Vlv.h>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace {
+
+// unpackVLV/readVLV -- the byte-by-byte decoder which File::read() used
+// before decodeVlv(), kept as reference and benchmark baseline.
+imp::ulong unpackVLV(imp::uchar a = 0, imp::uchar b = 0, imp::uchar c = 0, imp::uchar d = 0, imp::uchar e = 0) {
+    imp::uchar bytes[5] = {a, b, c, d, e};
+    int count = 0;
+    while ((count < 5) && (bytes[count] > 0x7f)) {
+        count++;
+    }
+    count++;
+    if (count >= 6) {
+        return 0;
+    }
+    imp::ulong output = 0;
+    for (int i = 0; i < count; i++) {
+        output = output << 7;
+        output = output | (bytes[i] & 0x7f);
+    }
+    return output;
+}
+
+std::size_t readVLV(const imp::uchar* pos, imp::ulong& value) {
+    imp::uchar b[5] = {0};
+    std::size_t i = 0;
+    for (; i < 5; i++) {
+        b[i] = pos[i];
+        if (b[i] < 0x80) {
+            break;
+        }
+    }
+    value = unpackVLV(b[0], b[1], b[2], b[3], b[4]);
+    return i + 1;
+}
+
+std::vector<imp::uchar> encode(imp::ulong value) {
+    std::vector<imp::uchar> bytes = {(imp::uchar) (value & 0x7f)};
+    while ((value >>= 7) != 0) {
+        bytes.insert(bytes.begin(), (imp::uchar) (0x80 | (value & 0x7f)));
+    }
+    return bytes;
+}
+
+// typical delta times: mostly short, some two- and three-byte values
+std::vector<imp::uchar> makeDeltaStream(int count) {
+    std::vector<imp::uchar> stream;
+    for (int i = 0; i < count; i++) {
+        imp::ulong value = i % 16 == 0 ? (imp::ulong) i * 37 : (imp::ulong) (i % 120);
+        auto bytes = encode(value);
+        stream.insert(stream.end(), bytes.begin(), bytes.end());
+    }
+    // padding, so that the reference decoder can always read 5 bytes
+    stream.insert(stream.end(), 5, 0);
+    return stream;
+}
+
+}// namespace
+
+TEST_CASE("Decode variable-length values") {
+    for (imp::ulong value : {0ul, 1ul, 0x7ful, 0x80ul, 0x2000ul, 0x3ffful, 0x4000ul, 0x1ffffful, 0x200000ul, 0x0ffffffful}) {
+        auto bytes = encode(value);
+        imp::ulong decoded = 0;
+
+        WHEN("The value is followed by more data") {
+            auto padded = bytes;
+            padded.insert(padded.end(), {0x81, 0x82, 0x83});
+            REQUIRE(imp::File::decodeVlv(padded.data(), padded.data() + padded.size(), decoded) == bytes.size());
+            REQUIRE(decoded == value);
+        }
+        WHEN("The value ends the buffer") {
+            REQUIRE(imp::File::decodeVlv(bytes.data(), bytes.data() + bytes.size(), decoded) == bytes.size());
+            REQUIRE(decoded == value);
+        }
+        WHEN("The value is truncated") {
+            REQUIRE(imp::File::decodeVlv(bytes.data(), bytes.data() + bytes.size() - 1, decoded) == 0);
+        }
+    }
+    WHEN("The value is longer than four bytes") {
+        std::vector<imp::uchar> bytes = {0x81, 0x80, 0x80, 0x80, 0x00};
+        imp::ulong decoded = 0;
+        REQUIRE(imp::File::decodeVlv(bytes.data(), bytes.data() + bytes.size(), decoded) == 0);
+    }
+    WHEN("A stream of delta times is decoded") {
+        auto stream = makeDeltaStream(1000);
+        const imp::uchar* pos = stream.data();
+        const imp::uchar* end = stream.data() + stream.size();
+        THEN("Every value matches the reference decoder") {
+            for (int i = 0; i < 1000; i++) {
+                imp::ulong expected;
+                imp::ulong decoded;
+                std::size_t length = readVLV(pos, expected);
+                REQUIRE(imp::File::decodeVlv(pos, end, decoded) == length);
+                REQUIRE(decoded == expected);
+                pos += length;
+            }
+        }
+    }
+}
+
+TEST_CASE("Decode the delta times of a whole track chunk") {
+    std::ifstream input("testdata/scratch.mid", std::ios::binary);
+    std::vector<imp::uchar> buffer{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+
+    // the chunks of the test file directly follow each other
+    const imp::uchar* pos = buffer.data() + 14;
+    for (int track = 0; track < data.getNumberOfTracks(); track++) {
+        std::size_t length = (pos[4] << 24) | (pos[5] << 16) | (pos[6] << 8) | pos[7];
+        std::vector<int> ticks;
+        REQUIRE(imp::File::decodeDeltaTimes({pos + 8, length}, ticks));
+        REQUIRE(ticks.size() == data[track].size());
+        for (std::size_t i = 0; i < ticks.size(); i++) {
+            REQUIRE(ticks[i] == data[track][i].tick);
+        }
+        pos += 8 + length;
+    }
+}
+
+TEST_CASE("Benchmark variable-length value decoding", "[.][benchmark]") {
+    auto stream = makeDeltaStream(100000);
+    const imp::uchar* end = stream.data() + stream.size();
+
+    BENCHMARK("byte-by-byte reference decoder") {
+        imp::ulong sum = 0;
+        const imp::uchar* pos = stream.data();
+        for (int i = 0; i < 100000; i++) {
+            imp::ulong value = 0;
+            pos += readVLV(pos, value);
+            sum += value;
+        }
+        return sum;
+    };
+
+    BENCHMARK("decodeVlv") {
+        imp::ulong sum = 0;
+        const imp::uchar* pos = stream.data();
+        for (int i = 0; i < 100000; i++) {
+            imp::ulong value = 0;
+            pos += imp::File::decodeVlv(pos, end, value);
+            sum += value;
+        }
+        return sum;
+    };
+}
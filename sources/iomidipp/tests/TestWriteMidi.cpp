@@ -0,0 +1,192 @@
+#include <catch2/catch_all.hpp>
+#include <iomidipp/MidiFile.h>
+#include <span>
+#include <thread>
+#include <vector>
+
+TEST_CASE("Write midi data into a single buffer") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+
+    WHEN("The file is written without changes") {
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data);
+        imp::MidiData reread = imp::File::read(std::as_bytes(std::span(buffer)));
+        THEN("Reading the buffer gives the same events") {
+            REQUIRE(reread.getTicksPerQuarterNote() == data.getTicksPerQuarterNote());
+            REQUIRE(reread.getNumberOfTracks() == data.getNumberOfTracks());
+            for (int track = 0; track < data.getNumberOfTracks(); track++) {
+                REQUIRE(reread[track].size() == data[track].size());
+                for (int event = 0; event < data[track].size(); event++) {
+                    REQUIRE(reread[track][event].tick == data[track][event].tick);
+                    REQUIRE(reread[track][event].getSize() == data[track][event].getSize());
+                    for (int i = 0; i < data[track][event].getSize(); i++) {
+                        REQUIRE(reread[track][event][i] == data[track][event][i]);
+                    }
+                }
+            }
+        }
+        THEN("The data is left in absolute ticks") {
+            REQUIRE(data.isAbsoluteTicks());
+            REQUIRE(data[1].back().tick > 0);
+        }
+    }
+    WHEN("A track ends without an end-of-track message") {
+        data[1].pop_back();
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data);
+        imp::MidiData reread = imp::File::read(std::as_bytes(std::span(buffer)));
+        THEN("One is added and the chunk length matches") {
+            REQUIRE(reread.getNumberOfTracks() == data.getNumberOfTracks());
+            REQUIRE(reread[1].size() == data[1].size() + 1);
+            REQUIRE(reread[1].back().isEndOfTrack());
+        }
+    }
+    WHEN("The last message of a track ends in the bytes of an end-of-track message") {
+        data[1].pop_back();
+        std::vector<imp::uchar> sysex = {0xf0, 0x01, 0xff, 0x2f, 0x00};
+        data.addEvent(1, data[1].back().tick, sysex);
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data);
+        imp::MidiData reread = imp::File::read(std::as_bytes(std::span(buffer)));
+        THEN("An end-of-track message is still added") {
+            REQUIRE(reread.getNumberOfTracks() == data.getNumberOfTracks());
+            REQUIRE(reread[1].size() == data[1].size() + 1);
+            REQUIRE(reread[1][reread[1].size() - 2].getSize() == 5);
+            REQUIRE(reread[1].back().isEndOfTrack());
+        }
+    }
+}
+
+TEST_CASE("Write midi data with running status") {
+    imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    std::vector<imp::uchar> plain = imp::File::writeToBuffer(data);
+
+    WHEN("Repeated status bytes are left out") {
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data, {.runningStatus = true});
+        imp::MidiData reread = imp::File::read(std::as_bytes(std::span(buffer)));
+        THEN("The file is smaller and reads back to the same events") {
+            REQUIRE(buffer.size() < plain.size());
+            REQUIRE(reread.getNumberOfTracks() == data.getNumberOfTracks());
+            for (int track = 0; track < data.getNumberOfTracks(); track++) {
+                REQUIRE(reread[track].size() == data[track].size());
+                for (int event = 0; event < data[track].size(); event++) {
+                    REQUIRE(reread[track][event].tick == data[track][event].tick);
+                    REQUIRE(reread[track][event].getSize() == data[track][event].getSize());
+                    for (int i = 0; i < data[track][event].getSize(); i++) {
+                        REQUIRE(reread[track][event][i] == data[track][event][i]);
+                    }
+                }
+            }
+        }
+    }
+    WHEN("Note-offs are also written as note-ons with velocity 0") {
+        data[1].insert(data[1].begin() + 1, imp::MidiEvent(0x80, 60, 64));
+        data[1].insert(data[1].begin() + 1, imp::MidiEvent(0x90, 60, 100));
+        std::vector<imp::uchar> running = imp::File::writeToBuffer(data, {.runningStatus = true});
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data, {.runningStatus = true, .noteOffAsZeroVelocity = true});
+        imp::MidiData reread = imp::File::read(std::as_bytes(std::span(buffer)));
+        THEN("The note-off shares the running status of the note-on") {
+            REQUIRE(buffer.size() < running.size());
+            REQUIRE(reread[1][1].isNoteOn());
+            REQUIRE(reread[1][2].isNoteOff());
+            REQUIRE(reread[1][2].getCommandByte() == 0x90);
+            REQUIRE(reread[1][2].getKeyNumber() == 60);
+            REQUIRE(reread[1][2].getVelocity() == 0);
+        }
+    }
+}
+
+TEST_CASE("Write midi data with an SMPTE time base") {
+    imp::MidiData data;
+    data.tracks().resize(1);
+    data.setMillisecondTicks();
+    std::vector<imp::uchar> note = {0x90, 60, 100};
+    data.addEvent(0, 1500, note);
+    imp::MidiEvent tempo;
+    tempo.makeTempo(60.0);
+    tempo.tick = 500;
+    data.addEvent(tempo);
+    data.sortTracks();
+
+    WHEN("The time is analyzed") {
+        THEN("Ticks are milliseconds and tempo messages are ignored") {
+            REQUIRE(data.isSmpteTimeBase());
+            REQUIRE(data.getTimeInSeconds(1000) == 1.0);
+            REQUIRE(data.getTimeInNanoseconds(1500) == 1500000000);
+            REQUIRE(data.getFileDurationInSeconds() == 1.5);
+        }
+    }
+    WHEN("The data is written and read back") {
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data);
+        imp::MidiData reread = imp::File::read(std::as_bytes(std::span(buffer)));
+        THEN("The division is kept") {
+            REQUIRE(buffer[12] == 0xE7);
+            REQUIRE(buffer[13] == 0x28);
+            REQUIRE(reread.getSmpteFramesPerSecond() == 25);
+            REQUIRE(reread.getSmpteSubframes() == 40);
+            REQUIRE(reread.getFileDurationInSeconds() == 1.5);
+        }
+    }
+    WHEN("The frame rate is 29.97 frames per second") {
+        data.setSmpteTimeBase(29, 100);
+        std::vector<imp::uchar> buffer = imp::File::writeToBuffer(data);
+        imp::MidiData reread = imp::File::read(std::as_bytes(std::span(buffer)));
+        THEN("2997 ticks are one second") {
+            REQUIRE(data.getTimeInNanoseconds(1500) == 500500000);
+            REQUIRE(reread.getSmpteFramesPerSecond() == 29);
+            REQUIRE(reread.getSmpteSubframes() == 100);
+            REQUIRE(reread.getTicksPerQuarterNote() == 3000);
+        }
+        THEN("A quarter note is 1.001 seconds, as in the tempo map") {
+            REQUIRE(data.getTicksPerQuarterNote() == data.getTempoMap()->getTicksPerQuarterNote());
+            REQUIRE(data.getFileDurationInTicks() == data.getTicksPerQuarterNote() / 2);
+            REQUIRE_THAT(reread.getFileDurationInSeconds(), Catch::Matchers::WithinAbs(0.5005, 1e-9));
+        }
+    }
+    WHEN("The SMPTE time base is out of range") {
+        THEN("It is rejected") {
+            REQUIRE_THROWS_AS(data.setSmpteTimeBase(0, 40), std::invalid_argument);
+            REQUIRE_THROWS_AS(data.setSmpteTimeBase(-25, 40), std::invalid_argument);
+            REQUIRE_THROWS_AS(data.setSmpteTimeBase(25, 0), std::invalid_argument);
+            REQUIRE_THROWS_AS(data.setSmpteTimeBase(25, 256), std::invalid_argument);
+            REQUIRE(data.getSmpteFramesPerSecond() == 25);
+        }
+    }
+    WHEN("The time base is set back to ticks per quarter note") {
+        data.setTicksPerQuarterNote(500);
+        THEN("Tempo messages count again") {
+            REQUIRE_FALSE(data.isSmpteTimeBase());
+            REQUIRE(data.getTimeInSeconds(1500) == 2.5);
+        }
+    }
+}
+
+TEST_CASE("Write shared midi data from several threads") {
+    const imp::MidiData data = imp::File::read("testdata/scratch.mid");
+    std::vector<imp::uchar> expected = imp::File::writeToBuffer(data);
+
+    WHEN("Several threads write the same data at once") {
+        std::vector<std::vector<imp::uchar>> buffers(4);
+        std::vector<std::thread> threads;
+        for (auto& buffer : buffers) {
+            threads.emplace_back([&data, &buffer] {
+                for (int i = 0; i < 10; i++) {
+                    buffer = imp::File::writeToBuffer(data);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        THEN("Every thread gets the same file") {
+            for (auto const& buffer : buffers) {
+                REQUIRE(buffer == expected);
+            }
+        }
+    }
+    WHEN("The data is in delta ticks") {
+        imp::MidiData delta = data;
+        delta.makeDeltaTicks();
+        THEN("The ticks are written as they are") {
+            REQUIRE(imp::File::writeToBuffer(delta) == expected);
+            REQUIRE(delta.isDeltaTicks());
+        }
+    }
+}